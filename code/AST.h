@@ -1,9 +1,13 @@
 #ifndef AST_H
 #define AST_H
 
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/raw_ostream.h"
+#include "symbol_table.h"
+#include <type_traits>
+#include <utility>
 
 
 class AST;                      // Abstract Syntax Tree
@@ -28,9 +32,9 @@ class ASTVisitor
 public:
 	// Virtual visit functions for each AST node type
 	virtual void visit(AST&) {}
-	virtual void visit(Expression&) {}
+	virtual void visit(Expression&) {}        // literals and identifiers
 	virtual void visit(Base&) = 0;
-	virtual void visit(Statement&) = 0;
+	virtual void visit(Statement& Node) { dispatch(Node); }
 	virtual void visit(BinaryOp&) = 0;
 	virtual void visit(DecStatement&) = 0;
 	virtual void visit(AssignStatement&) = 0;
@@ -41,6 +45,11 @@ public:
     virtual void visit(PrintStatement&) = 0;
 	virtual void visit(ForStatement&) = 0;
 	virtual void visit(WhileStatement&) = 0;
+
+	// Route a node to the visit overload of its concrete class with a switch
+	// on its kind, costing one virtual call instead of accept() plus visit().
+	inline void dispatch(Statement& Node);
+	inline void dispatch(Expression& Node);
 };
 
 class AST {
@@ -49,7 +58,7 @@ public:
 	virtual void accept(ASTVisitor& V) = 0;
 };
 
-class TopLevelEntity : AST {
+class TopLevelEntity : public AST {
 public:
 	TopLevelEntity() {}
 };
@@ -57,7 +66,7 @@ public:
 
 class Expression : public TopLevelEntity {
 public:
-	enum ExpressionType {
+	enum ExpressionType : unsigned char {
 		Number,
 		Identifier,
 		Boolean,
@@ -66,18 +75,36 @@ public:
 	};
 private:
 	ExpressionType Type;
-	llvm::StringRef Value;
-	int NumberVal;
-	bool BoolVal;
-	BooleanOp* BOVal;
+protected:
+	unsigned char Op;                               // operator of BinaryOp and BooleanOp
+	unsigned Symbol;                                // interned name of identifiers
+	// literal, identifier and operand payloads share storage, only the
+	// member matching Type is valid
+	union {
+		struct {
+			const char *Data;
+			size_t Length;
+		} Name;
+		struct {
+			Expression *Left;
+			Expression *Right;
+		} Operands;
+		int NumberVal;
+		bool BoolVal;
+	};
+
+	Expression(ExpressionType type, unsigned char op, Expression *L, Expression *R) : Type(type), Op(op), Symbol(0) {
+		Operands.Left = L;
+		Operands.Right = R;
+	}
 
 public:
-	Expression() {}
-	Expression(llvm::StringRef value) : Type(ExpressionType::Identifier), Value(value) {} // store string
-	Expression(int value) : Type(ExpressionType::Number), NumberVal(value) {} // store number
-	Expression(bool value) : Type(ExpressionType::Boolean), BoolVal(value) {} // store boolean
-	Expression(BooleanOp* value) : Type(ExpressionType::BooleanOpType), BOVal(value) {} // store boolean
-	Expression(ExpressionType type) : Type(type) {}
+	Expression(llvm::StringRef value, unsigned symbol) : Type(ExpressionType::Identifier), Op(0), Symbol(symbol) { // store string
+		Name.Data = value.data();
+		Name.Length = value.size();
+	}
+	Expression(int value) : Type(ExpressionType::Number), Op(0), Symbol(0) { NumberVal = value; } // store number
+	Expression(bool value) : Type(ExpressionType::Boolean), Op(0), Symbol(0) { BoolVal = value; } // store boolean
 
 	bool isNumber() {
 		if (Type == ExpressionType::Number)
@@ -110,15 +137,18 @@ public:
 	}
 
 	llvm::StringRef getValue() {
-		return Value;
+		if (Type != ExpressionType::Identifier)
+			return llvm::StringRef();
+		return llvm::StringRef(Name.Data, Name.Length);
 	}
 
-	int getNumber() {
-		return NumberVal;
+	// interned ID of an identifier's name, see SymbolTable
+	unsigned getSymbol() {
+		return Symbol;
 	}
 
-	BooleanOp* getBooleanOp() {
-		return BOVal;
+	int getNumber() {
+		return NumberVal;
 	}
 
 	bool getBoolean() {
@@ -138,7 +168,7 @@ public:
 class BooleanOp : public Expression
 {
 public:
-	enum Operator
+	enum Operator : unsigned char
 	{
 		LessEqual,
 		Less,
@@ -150,19 +180,14 @@ public:
 		Or
 	};
 
-private:
-	Expression* Left;                               
-	Expression* Right;                              
-	Operator Op;
-
 public:
-	BooleanOp(Operator Op, Expression* L, Expression* R) : Op(Op), Left(L), Right(R), Expression(ExpressionType::BooleanOpType) { }
+	BooleanOp(Operator Op, Expression* L, Expression* R) : Expression(ExpressionType::BooleanOpType, Op, L, R) { }
 
-	Expression* getLeft() { return Left; }
+	Expression* getLeft() { return Operands.Left; }
 
-	Expression* getRight() { return Right; }
+	Expression* getRight() { return Operands.Right; }
 
-	Operator getOperator() { return Op; }
+	Operator getOperator() { return (Operator)Op; }
 
 	virtual void accept(ASTVisitor& V) override
 	{
@@ -174,7 +199,7 @@ public:
 class BinaryOp : public Expression
 {
 public:
-	enum Operator
+	enum Operator : unsigned char
 	{
 		Plus,
 		Minus,
@@ -184,19 +209,14 @@ public:
 		Pow
 	};
 
-private:
-	Expression* Left;                               // Left-hand side expression
-	Expression* Right;                              // Right-hand side expression
-	Operator Op;                              // Operator of the binary operation
-
 public:
-	BinaryOp(Operator Op, Expression* L, Expression* R) : Op(Op), Left(L), Right(R), Expression(ExpressionType::BinaryOpType) {}
+	BinaryOp(Operator Op, Expression* L, Expression* R) : Expression(ExpressionType::BinaryOpType, Op, L, R) {}
 
-	Expression* getLeft() { return Left; }
+	Expression* getLeft() { return Operands.Left; }                  // Left-hand side expression
 
-	Expression* getRight() { return Right; }
+	Expression* getRight() { return Operands.Right; }                // Right-hand side expression
 
-	Operator getOperator() { return Op; }
+	Operator getOperator() { return (Operator)Op; }                 // Operator of the binary operation
 
 	virtual void accept(ASTVisitor& V) override
 	{
@@ -204,6 +224,12 @@ public:
 	}
 };
 
+// operator nodes reuse the payload storage of Expression, keep every
+// expression node within a single cache line
+static_assert(sizeof(BinaryOp) == sizeof(Expression) && sizeof(BooleanOp) == sizeof(Expression),
+	"operator nodes must not grow Expression");
+static_assert(sizeof(Expression) <= 64, "Expression must fit in a cache line");
+
 
 class Base : public AST
 {
@@ -211,8 +237,9 @@ private:
     llvm::SmallVector<Statement *> statements;
 
 public:
-    Base(llvm::SmallVector<Statement *> Statements) : statements(Statements) {}
-    llvm::SmallVector<Statement *> getStatements() { return statements; }
+    Base(llvm::SmallVector<Statement *> Statements) : statements(std::move(Statements)) {}
+    llvm::ArrayRef<Statement *> getStatements() { return statements; }
+    void setStatements(llvm::SmallVector<Statement *> Statements) { statements = std::move(Statements); }
 
     llvm::SmallVector<Statement *>::const_iterator begin() { return statements.begin(); }
 
@@ -266,6 +293,10 @@ class PrintStatement : public Statement
     {
         return expr;
     }
+    void setExpr(Expression *E)
+    {
+        expr = E;
+    }
     virtual void accept(ASTVisitor &V) override
     {
         V.visit(*this);
@@ -283,13 +314,12 @@ private:
 
 	Expression* lvalue;
 	Expression* rvalue;
-	Statement::StatementType type;
 	DecStatement::DecStatementType dec_type;
 
 public:
-	DecStatement(Expression* lvalue, Expression* rvalue) : lvalue(lvalue), rvalue(rvalue), type(Statement::StatementType::Declaration), Statement(type) { }
-	DecStatement(Expression* lvalue) : lvalue(lvalue), rvalue(rvalue), type(Statement::StatementType::Declaration), Statement(type) { rvalue = new Expression(0); }
-	DecStatement(Expression* lvalue, Expression* rvalue, DecStatement::DecStatementType dec_type) : lvalue(lvalue), rvalue(rvalue), type(Statement::StatementType::Declaration), dec_type(dec_type), Statement(type) { }
+	DecStatement(Expression* lvalue, Expression* rvalue) : lvalue(lvalue), rvalue(rvalue), Statement(Statement::StatementType::Declaration) { }
+	DecStatement(Expression* lvalue) : lvalue(lvalue), rvalue(nullptr), Statement(Statement::StatementType::Declaration) { }
+	DecStatement(Expression* lvalue, Expression* rvalue, DecStatement::DecStatementType dec_type) : lvalue(lvalue), rvalue(rvalue), dec_type(dec_type), Statement(Statement::StatementType::Declaration) { }
 
 	Expression* getLValue() {
 		return lvalue;
@@ -299,6 +329,10 @@ public:
 		return rvalue;
 	}
 
+	void setRValue(Expression* E) {
+		rvalue = E;
+	}
+
 	DecStatementType getDecType() {
 		return dec_type;
 	}
@@ -315,10 +349,9 @@ private:
 
 	Expression* lvalue;
 	Expression* rvalue;
-	Statement::StatementType type;
 
 public:
-	AssignStatement(Expression* lvalue, Expression* rvalue) : lvalue(lvalue), rvalue(rvalue), type(Statement::StatementType::Assignment), Statement(type) { }
+	AssignStatement(Expression* lvalue, Expression* rvalue) : lvalue(lvalue), rvalue(rvalue), Statement(Statement::StatementType::Assignment) { }
 	Expression* getLValue() {
 		return lvalue;
 	}
@@ -327,6 +360,10 @@ public:
 		return rvalue;
 	}
 
+	void setRValue(Expression* E) {
+		rvalue = E;
+	}
+
 	virtual void accept(ASTVisitor& V) override
 	{
 		V.visit(*this);
@@ -352,8 +389,8 @@ public:
                 bool hasElseIf,
                 bool hasElse,
                 StatementType type) : condition(condition),
-                                      statements(statements),
-                                      elseIfStatements(elseIfStatements),
+                                      statements(std::move(statements)),
+                                      elseIfStatements(std::move(elseIfStatements)),
                                       elseStatement(elseStatement),
                                       hasElseIf(hasElseIf),
                                       hasElse(hasElse),
@@ -364,6 +401,11 @@ public:
         return condition;
     }
 
+    void setCondition(Expression *E)
+    {
+        condition = E;
+    }
+
     bool HasElseIf()
     {
         return hasElseIf;
@@ -374,16 +416,21 @@ public:
         return hasElse;
     }
 
-    llvm::SmallVector<ElseIfStatement *> getElseIfStatements()
+    llvm::ArrayRef<ElseIfStatement *> getElseIfStatements()
     {
         return elseIfStatements;
     }
 
-    llvm::SmallVector<Statement *> getStatements()
+    llvm::ArrayRef<Statement *> getStatements()
     {
         return statements;
     }
 
+    void setStatements(llvm::SmallVector<Statement *> Statements)
+    {
+        statements = std::move(Statements);
+    }
+
     ElseStatement *getElseStatement()
     {
         return elseStatement;
@@ -403,18 +450,28 @@ private:
     llvm::SmallVector<Statement *> statements;
 
 public:
-    ElseIfStatement(Expression *condition, llvm::SmallVector<Statement *> statements, StatementType type) : condition(condition), statements(statements), Statement(type) {}
+    ElseIfStatement(Expression *condition, llvm::SmallVector<Statement *> statements, StatementType type) : condition(condition), statements(std::move(statements)), Statement(type) {}
 
     Expression *getCondition()
     {
         return condition;
     }
 
-    llvm::SmallVector<Statement *> getStatements()
+    void setCondition(Expression *E)
+    {
+        condition = E;
+    }
+
+    llvm::ArrayRef<Statement *> getStatements()
     {
         return statements;
     }
 
+    void setStatements(llvm::SmallVector<Statement *> Statements)
+    {
+        statements = std::move(Statements);
+    }
+
     virtual void accept(ASTVisitor &V) override
     {
         V.visit(*this);
@@ -428,13 +485,18 @@ private:
     llvm::SmallVector<Statement *> statements;
 
 public:
-    ElseStatement(llvm::SmallVector<Statement *> statements, Statement::StatementType type) : statements(statements), Statement(type) {}
+    ElseStatement(llvm::SmallVector<Statement *> statements, Statement::StatementType type) : statements(std::move(statements)), Statement(type) {}
 
-    llvm::SmallVector<Statement *> getStatements()
+    llvm::ArrayRef<Statement *> getStatements()
     {
         return statements;
     }
 
+    void setStatements(llvm::SmallVector<Statement *> Statements)
+    {
+        statements = std::move(Statements);
+    }
+
     virtual void accept(ASTVisitor &V) override
     {
         V.visit(*this);
@@ -449,18 +511,28 @@ private:
 	bool optimized;
 
 public:
-	WhileStatement(Expression* condition, llvm::SmallVector<Statement*> statements, StatementType type) : condition(condition), statements(statements), Statement(type) {}
-	WhileStatement(Expression* condition, llvm::SmallVector<Statement*> statements, StatementType type, bool optimized) : condition(condition), statements(statements), Statement(type), optimized(optimized) { }
+	WhileStatement(Expression* condition, llvm::SmallVector<Statement*> statements, StatementType type) : condition(condition), statements(std::move(statements)), Statement(type), optimized(false) {}
+	WhileStatement(Expression* condition, llvm::SmallVector<Statement*> statements, StatementType type, bool optimized) : condition(condition), statements(std::move(statements)), Statement(type), optimized(optimized) { }
 	Expression* getCondition()
 	{
 		return condition;
 	}
 
-	llvm::SmallVector<Statement*> getStatements()
+	void setCondition(Expression* E)
+	{
+		condition = E;
+	}
+
+	llvm::ArrayRef<Statement*> getStatements()
 	{
 		return statements;
 	}
 
+	void setStatements(llvm::SmallVector<Statement*> Statements)
+	{
+		statements = std::move(Statements);
+	}
+
 	virtual void accept(ASTVisitor& V) override
 	{
 		V.visit(*this);
@@ -480,17 +552,27 @@ private:
 	AssignStatement *update_assign;
 	bool optimized;
 public:
-	ForStatement(Expression* condition,llvm::SmallVector<Statement*> statements,AssignStatement *initial_assign,AssignStatement *update_assign, Statement type ) : condition(condition), statements(statements),initial_assign(initial_assign),update_assign(update_assign) , Statement(type){}
-	ForStatement(Expression* condition,llvm::SmallVector<Statement*> statements,AssignStatement *initial_assign,AssignStatement *update_assign, Statement type, bool optimized) : condition(condition), statements(statements),initial_assign(initial_assign),update_assign(update_assign) , Statement(type), optimized(optimized){}
+	ForStatement(Expression* condition,llvm::SmallVector<Statement*> statements,AssignStatement *initial_assign,AssignStatement *update_assign, StatementType type ) : condition(condition), statements(std::move(statements)),initial_assign(initial_assign),update_assign(update_assign) , Statement(type), optimized(false){}
+	ForStatement(Expression* condition,llvm::SmallVector<Statement*> statements,AssignStatement *initial_assign,AssignStatement *update_assign, StatementType type, bool optimized) : condition(condition), statements(std::move(statements)),initial_assign(initial_assign),update_assign(update_assign) , Statement(type), optimized(optimized){}
 	Expression* getCondition()
 	{
 		return condition;
 	}
 
-	llvm::SmallVector<Statement*> getStatements()
+	void setCondition(Expression* E)
+	{
+		condition = E;
+	}
+
+	llvm::ArrayRef<Statement*> getStatements()
 	{
 		return statements;
 	}
+
+	void setStatements(llvm::SmallVector<Statement*> Statements)
+	{
+		statements = std::move(Statements);
+	}
 	bool isOptimized(){
 		return optimized;
 	}
@@ -506,4 +588,118 @@ public:
 	}
 
 };
+
+void ASTVisitor::dispatch(Statement& Node)
+{
+	switch (Node.getKind())
+	{
+	case Statement::StatementType::If:
+		visit(static_cast<IfStatement&>(Node));
+		break;
+	case Statement::StatementType::ElseIf:
+		visit(static_cast<ElseIfStatement&>(Node));
+		break;
+	case Statement::StatementType::Else:
+		visit(static_cast<ElseStatement&>(Node));
+		break;
+	case Statement::StatementType::Print:
+		visit(static_cast<PrintStatement&>(Node));
+		break;
+	case Statement::StatementType::Declaration:
+		visit(static_cast<DecStatement&>(Node));
+		break;
+	case Statement::StatementType::Assignment:
+		visit(static_cast<AssignStatement&>(Node));
+		break;
+	case Statement::StatementType::While:
+		visit(static_cast<WhileStatement&>(Node));
+		break;
+	case Statement::StatementType::For:
+		visit(static_cast<ForStatement&>(Node));
+		break;
+	}
+}
+
+void ASTVisitor::dispatch(Expression& Node)
+{
+	switch (Node.getKind())
+	{
+	case Expression::ExpressionType::BinaryOpType:
+		visit(static_cast<BinaryOp&>(Node));
+		break;
+	case Expression::ExpressionType::BooleanOpType:
+		visit(static_cast<BooleanOp&>(Node));
+		break;
+	default:
+		visit(Node);
+		break;
+	}
+}
+
+// Owns every AST node of one compilation unit. Nodes are bump-allocated and
+// the whole tree is released at once by reset() or the destructor.
+class ASTContext
+{
+private:
+	llvm::BumpPtrAllocator Allocator;
+	// statement nodes own their SmallVectors and must be destroyed explicitly,
+	// expressions hold no resources so their destructors are skipped
+	llvm::SmallVector<AST *> OwningNodes;
+	unsigned NumExpressions = 0;
+	unsigned NumStatements = 0;
+	SymbolTable Symbols;
+
+public:
+	ASTContext() {}
+	ASTContext(const ASTContext &) = delete;
+	ASTContext &operator=(const ASTContext &) = delete;
+	~ASTContext() { reset(); }
+
+	template <typename T, typename... Args>
+	T *create(Args &&...args)
+	{
+		T *Node = new (Allocator.Allocate<T>()) T(std::forward<Args>(args)...);
+		if (std::is_base_of<Expression, T>::value)
+			++NumExpressions;
+		else
+		{
+			++NumStatements;
+			OwningNodes.push_back(Node);
+		}
+		return Node;
+	}
+
+	// destroys all nodes and gives the memory back in one shot
+	void reset()
+	{
+		for (AST *Node : OwningNodes)
+			Node->~AST();
+		OwningNodes.clear();
+		NumExpressions = 0;
+		NumStatements = 0;
+		Symbols.clear();
+		Allocator.Reset();
+	}
+
+	SymbolTable &getSymbols() { return Symbols; }
+
+	unsigned getNumNodes() const { return NumExpressions + NumStatements; }
+
+	size_t getBytesAllocated() const { return Allocator.getBytesAllocated(); }
+
+	// memory-per-node report of the nodes currently alive
+	void printStats(llvm::raw_ostream &OS) const
+	{
+		unsigned NumNodes = NumExpressions + NumStatements;
+		OS << "AST nodes: " << NumNodes << " (" << NumExpressions << " expressions, "
+		   << NumStatements << " statements)\n";
+		OS << "arena bytes: " << getBytesAllocated();
+		if (NumNodes)
+			OS << " (" << getBytesAllocated() / NumNodes << " bytes/node)";
+		OS << "\n";
+		OS << "sizeof(Expression) = " << sizeof(Expression)
+		   << ", sizeof(BinaryOp) = " << sizeof(BinaryOp)
+		   << ", sizeof(BooleanOp) = " << sizeof(BooleanOp) << "\n";
+	}
+};
 #endif
@@ -1,15 +1,236 @@
 #include "code_generator.h"
-#include "optimizer.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/DivisionByConstantInfo.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdint>
+#include <vector>
 
 using namespace llvm;
 
 // Define a visitor class for generating LLVM IR from the AST.
 namespace
 {
+    bool assignsSymbol(llvm::ArrayRef<Statement *> Stmts, unsigned Symbol);
+
+    // true if Stmt may write Symbol
+    bool assignsSymbol(Statement *Stmt, unsigned Symbol)
+    {
+        switch (Stmt->getKind())
+        {
+        case Statement::StatementType::Declaration:
+            return ((DecStatement *)Stmt)->getLValue()->getSymbol() == Symbol;
+        case Statement::StatementType::Assignment:
+            return ((AssignStatement *)Stmt)->getLValue()->getSymbol() == Symbol;
+        case Statement::StatementType::If:
+        {
+            IfStatement *ifStatement = (IfStatement *)Stmt;
+            if (assignsSymbol(ifStatement->getStatements(), Symbol))
+                return true;
+            for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                if (assignsSymbol(elseIf->getStatements(), Symbol))
+                    return true;
+            return ifStatement->HasElse() && assignsSymbol(ifStatement->getElseStatement()->getStatements(), Symbol);
+        }
+        case Statement::StatementType::ElseIf:
+            return assignsSymbol(((ElseIfStatement *)Stmt)->getStatements(), Symbol);
+        case Statement::StatementType::Else:
+            return assignsSymbol(((ElseStatement *)Stmt)->getStatements(), Symbol);
+        case Statement::StatementType::While:
+            return assignsSymbol(((WhileStatement *)Stmt)->getStatements(), Symbol);
+        case Statement::StatementType::For:
+        {
+            ForStatement *forStatement = (ForStatement *)Stmt;
+            return forStatement->getInitialAssign()->getLValue()->getSymbol() == Symbol ||
+                   forStatement->getUpdateAssign()->getLValue()->getSymbol() == Symbol ||
+                   assignsSymbol(forStatement->getStatements(), Symbol);
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool assignsSymbol(llvm::ArrayRef<Statement *> Stmts, unsigned Symbol)
+    {
+        for (Statement *Stmt : Stmts)
+            if (assignsSymbol(Stmt, Symbol))
+                return true;
+        return false;
+    }
+
+    // constant divisor of `Symbol % m` when m >= 2, otherwise 0
+    int32_t getModulusOf(Expression *Expr, unsigned Symbol)
+    {
+        if (Expr->getKind() != Expression::ExpressionType::BinaryOpType)
+            return 0;
+        BinaryOp *binaryOp = (BinaryOp *)Expr;
+        Expression *Left = binaryOp->getLeft();
+        Expression *Right = binaryOp->getRight();
+        if (binaryOp->getOperator() != BinaryOp::Mod ||
+            Left->getKind() != Expression::ExpressionType::Identifier || Left->getSymbol() != Symbol ||
+            Right->getKind() != Expression::ExpressionType::Number || Right->getNumber() < 2)
+            return 0;
+        return Right->getNumber();
+    }
+
+    // collects the distinct m of every `Symbol % m` in Expr
+    void collectModuli(Expression *Expr, unsigned Symbol, llvm::SmallVectorImpl<int32_t> &Moduli)
+    {
+        if (int32_t Modulus = getModulusOf(Expr, Symbol))
+        {
+            if (!llvm::is_contained(Moduli, Modulus))
+                Moduli.push_back(Modulus);
+            return;
+        }
+        if (Expr->getKind() == Expression::ExpressionType::BinaryOpType)
+        {
+            collectModuli(((BinaryOp *)Expr)->getLeft(), Symbol, Moduli);
+            collectModuli(((BinaryOp *)Expr)->getRight(), Symbol, Moduli);
+        }
+        else if (Expr->getKind() == Expression::ExpressionType::BooleanOpType)
+        {
+            collectModuli(((BooleanOp *)Expr)->getLeft(), Symbol, Moduli);
+            collectModuli(((BooleanOp *)Expr)->getRight(), Symbol, Moduli);
+        }
+    }
+
+    void collectModuli(llvm::ArrayRef<Statement *> Stmts, unsigned Symbol, llvm::SmallVectorImpl<int32_t> &Moduli)
+    {
+        for (Statement *Stmt : Stmts)
+        {
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::Declaration:
+                if (((DecStatement *)Stmt)->getRValue())
+                    collectModuli(((DecStatement *)Stmt)->getRValue(), Symbol, Moduli);
+                break;
+            case Statement::StatementType::Assignment:
+                collectModuli(((AssignStatement *)Stmt)->getRValue(), Symbol, Moduli);
+                break;
+            case Statement::StatementType::Print:
+                collectModuli(((PrintStatement *)Stmt)->getExpr(), Symbol, Moduli);
+                break;
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                collectModuli(ifStatement->getCondition(), Symbol, Moduli);
+                collectModuli(ifStatement->getStatements(), Symbol, Moduli);
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                {
+                    collectModuli(elseIf->getCondition(), Symbol, Moduli);
+                    collectModuli(elseIf->getStatements(), Symbol, Moduli);
+                }
+                if (ifStatement->HasElse())
+                    collectModuli(ifStatement->getElseStatement()->getStatements(), Symbol, Moduli);
+                break;
+            }
+            case Statement::StatementType::While:
+                collectModuli(((WhileStatement *)Stmt)->getCondition(), Symbol, Moduli);
+                collectModuli(((WhileStatement *)Stmt)->getStatements(), Symbol, Moduli);
+                break;
+            case Statement::StatementType::For:
+            {
+                ForStatement *forStatement = (ForStatement *)Stmt;
+                collectModuli(forStatement->getInitialAssign()->getRValue(), Symbol, Moduli);
+                collectModuli(forStatement->getCondition(), Symbol, Moduli);
+                collectModuli(forStatement->getUpdateAssign()->getRValue(), Symbol, Moduli);
+                collectModuli(forStatement->getStatements(), Symbol, Moduli);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    // true if evaluating Expr costs at most Budget nodes and cannot trap or
+    // loop, i.e. it is fine to evaluate it even when its value is not needed
+    bool isCheapExpression(Expression *Expr, unsigned &Budget)
+    {
+        if (Budget == 0)
+            return false;
+        --Budget;
+        if (Expr->getKind() == Expression::ExpressionType::BinaryOpType)
+        {
+            BinaryOp *binaryOp = (BinaryOp *)Expr;
+            if (binaryOp->getOperator() == BinaryOp::Div || binaryOp->getOperator() == BinaryOp::Mod ||
+                binaryOp->getOperator() == BinaryOp::Pow)
+                return false;
+            return isCheapExpression(binaryOp->getLeft(), Budget) && isCheapExpression(binaryOp->getRight(), Budget);
+        }
+        if (Expr->getKind() == Expression::ExpressionType::BooleanOpType)
+        {
+            BooleanOp *booleanOp = (BooleanOp *)Expr;
+            return isCheapExpression(booleanOp->getLeft(), Budget) && isCheapExpression(booleanOp->getRight(), Budget);
+        }
+        return true;
+    }
+
+    // c of an update `Symbol = Symbol + c` or `Symbol = c + Symbol`, 0 for any other form
+    int32_t getConstantStep(AssignStatement *Update, unsigned Symbol)
+    {
+        Expression *Value = Update->getRValue();
+        if (Update->getLValue()->getSymbol() != Symbol || Value->getKind() != Expression::ExpressionType::BinaryOpType)
+            return 0;
+        BinaryOp *binaryOp = (BinaryOp *)Value;
+        if (binaryOp->getOperator() != BinaryOp::Plus)
+            return 0;
+        Expression *Left = binaryOp->getLeft();
+        Expression *Right = binaryOp->getRight();
+        if (Right->getKind() == Expression::ExpressionType::Identifier)
+            std::swap(Left, Right);
+        if (Left->getKind() != Expression::ExpressionType::Identifier || Left->getSymbol() != Symbol ||
+            Right->getKind() != Expression::ExpressionType::Number)
+            return 0;
+        return Right->getNumber();
+    }
+
+    // true if `Symbol Op c`, c a literal and Op < or <=, stops a loop that
+    // starts Symbol at Start and adds Step > 0 before Symbol would wrap
+    bool hasBoundedTrips(Expression *Condition, unsigned Symbol, int32_t Start, int32_t Step)
+    {
+        if (Condition->getKind() != Expression::ExpressionType::BooleanOpType)
+            return false;
+        BooleanOp *Compare = (BooleanOp *)Condition;
+        BooleanOp::Operator Op = Compare->getOperator();
+        Expression *Left = Compare->getLeft();
+        Expression *Right = Compare->getRight();
+        if (Right->getKind() == Expression::ExpressionType::Identifier)
+        {
+            std::swap(Left, Right);
+            if (Op == BooleanOp::Greater)
+                Op = BooleanOp::Less;
+            else if (Op == BooleanOp::GreaterEqual)
+                Op = BooleanOp::LessEqual;
+            else
+                return false;
+        }
+        if (Left->getKind() != Expression::ExpressionType::Identifier || Left->getSymbol() != Symbol ||
+            Right->getKind() != Expression::ExpressionType::Number ||
+            (Op != BooleanOp::Less && Op != BooleanOp::LessEqual))
+            return false;
+
+        // same count as checkDirection in the optimizer
+        int64_t Distance = (int64_t)Right->getNumber() - Start;
+        if (Op == BooleanOp::LessEqual)
+            ++Distance;
+        int64_t Trips = Distance <= 0 ? 0 : (Distance + Step - 1) / Step;
+        return Start + Trips * Step <= INT32_MAX;
+    }
+
     class ToIRVisitor : public ASTVisitor
     {
         Module *M;
@@ -23,7 +244,16 @@ namespace
         Constant *Int1Zero;
 
         Value *V;
-        StringMap<AllocaInst *> nameMap;
+
+        // Variables are kept in SSA registers instead of allocas, following
+        // Braun et al., "Simple and Efficient Construction of SSA Form": a read
+        // looks up the definition reaching the block and places phis on demand.
+        // Variables are symbol IDs, temporaries are numbered after the symbols.
+        std::vector<DenseMap<BasicBlock *, WeakTrackingVH>> CurrentDef; // indexed by variable
+        std::vector<Type *> VarTypes;                                     // nullptr until declared
+        llvm::SmallVector<StringRef, 4> TemporaryNames;
+        DenseMap<BasicBlock *, llvm::SmallVector<std::pair<unsigned, PHINode *>, 4>> IncompletePhis;
+        SmallPtrSet<BasicBlock *, 32> Sealed;
 
         llvm::FunctionType *MainFty;
         llvm::Function *MainFn;
@@ -31,13 +261,21 @@ namespace
         FunctionType *CalcWriteFnTyBool;
         Function *CalcWriteFn;
         Function *CalcWriteFnBool;
-        bool optimize;
-        int k;
-        
+        ASTContext &Context;
+
+        // temporary kept equal to Symbol % Modulus while the owning for loop runs
+        struct RotatingCounter
+        {
+            unsigned Symbol;
+            int32_t Modulus;
+            unsigned Counter;
+        };
+        llvm::SmallVector<RotatingCounter, 4> Counters;
+
 
     public:
         // Constructor for the visitor class
-        ToIRVisitor(Module *M, bool optimize_enable, int k_value) : M(M), Builder(M->getContext())
+        ToIRVisitor(Module *M, ASTContext &Context) : M(M), Builder(M->getContext()), Context(Context)
         {
             // Initialize LLVM types and constants
             VoidTy = Type::getVoidTy(M->getContext());
@@ -50,8 +288,120 @@ namespace
             CalcWriteFnTyBool = FunctionType::get(VoidTy, {Int1Ty}, false);
             CalcWriteFn = Function::Create(CalcWriteFnTy, GlobalValue::ExternalLinkage, "print", M);
             CalcWriteFnBool = Function::Create(CalcWriteFnTyBool, GlobalValue::ExternalLinkage, "printBool", M);
-            optimize = optimize_enable;
-            k = k_value;
+            CurrentDef.resize(Context.getSymbols().size());
+            VarTypes.resize(Context.getSymbols().size(), nullptr);
+        }
+
+        unsigned createTemporary(Type *Ty, StringRef Name)
+        {
+            CurrentDef.emplace_back();
+            VarTypes.push_back(Ty);
+            TemporaryNames.push_back(Name);
+            return VarTypes.size() - 1;
+        }
+
+        void writeVariable(unsigned Var, BasicBlock *BB, Value *Val)
+        {
+            CurrentDef[Var][BB] = Val;
+        }
+
+        Value *readVariable(unsigned Var, BasicBlock *BB)
+        {
+            auto Def = CurrentDef[Var].find(BB);
+            if (Def != CurrentDef[Var].end())
+                return Def->second;
+            return readVariableRecursive(Var, BB);
+        }
+
+        Value *readVariableRecursive(unsigned Var, BasicBlock *BB)
+        {
+            Value *Val;
+            if (!Sealed.count(BB))
+            {
+                // not all predecessors are known yet, complete the phi on sealing
+                PHINode *Phi = createPhi(Var, BB);
+                IncompletePhis[BB].push_back({Var, Phi});
+                Val = Phi;
+            }
+            else if (BB->hasNPredecessors(0))
+            {
+                // read before its declaration ran, e.g. a temporary declared inside a loop
+                Val = Constant::getNullValue(VarTypes[Var]);
+            }
+            else if (BasicBlock *Pred = BB->getUniquePredecessor())
+            {
+                Val = readVariable(Var, Pred);
+            }
+            else
+            {
+                // define the phi first so that reads around a loop find it
+                PHINode *Phi = createPhi(Var, BB);
+                writeVariable(Var, BB, Phi);
+                Val = addPhiOperands(Var, Phi);
+            }
+            writeVariable(Var, BB, Val);
+            return Val;
+        }
+
+        PHINode *createPhi(unsigned Var, BasicBlock *BB)
+        {
+            unsigned NumSymbols = Context.getSymbols().size();
+            StringRef Name = Var < NumSymbols ? Context.getSymbols().getName(Var) : TemporaryNames[Var - NumSymbols];
+            if (BB->empty())
+                return PHINode::Create(VarTypes[Var], 0, Name, BB);
+            return PHINode::Create(VarTypes[Var], 0, Name, &BB->front());
+        }
+
+        Value *addPhiOperands(unsigned Var, PHINode *Phi)
+        {
+            for (BasicBlock *Pred : predecessors(Phi->getParent()))
+                Phi->addIncoming(readVariable(Var, Pred), Pred);
+            return tryRemoveTrivialPhi(Phi);
+        }
+
+        // a phi merging a single value (besides itself) is replaced by that value
+        Value *tryRemoveTrivialPhi(PHINode *Phi)
+        {
+            Value *Same = nullptr;
+            for (Value *Op : Phi->incoming_values())
+            {
+                if (Op == Same || Op == Phi)
+                    continue;
+                if (Same)
+                    return Phi;
+                Same = Op;
+            }
+            if (!Same)
+                Same = UndefValue::get(Phi->getType());
+
+            llvm::SmallVector<WeakVH, 8> Users;
+            for (User *U : Phi->users())
+                if (U != Phi && isa<PHINode>(U))
+                    Users.push_back(U);
+
+            // the definitions are tracking handles and follow the replacement
+            Phi->replaceAllUsesWith(Same);
+            Phi->eraseFromParent();
+
+            // removing this phi may have made phis using it trivial as well
+            for (WeakVH &U : Users)
+                if (PHINode *UserPhi = dyn_cast_or_null<PHINode>(U))
+                    tryRemoveTrivialPhi(UserPhi);
+            return Same;
+        }
+
+        // called once all predecessors of BB have been created
+        void sealBlock(BasicBlock *BB)
+        {
+            auto Pending = IncompletePhis.find(BB);
+            if (Pending != IncompletePhis.end())
+            {
+                llvm::SmallVector<std::pair<unsigned, PHINode *>, 4> Phis = std::move(Pending->second);
+                IncompletePhis.erase(Pending);
+                for (auto &Phi : Phis)
+                    addPhiOperands(Phi.first, Phi.second);
+            }
+            Sealed.insert(BB);
         }
 
         // Entry point for generating LLVM IR from the AST
@@ -64,6 +414,7 @@ namespace
             // Create a basic block for the entry point of the main function.
             BasicBlock *BB = BasicBlock::Create(M->getContext(), "entry", MainFn);
             Builder.SetInsertPoint(BB);
+            sealBlock(BB);
 
             // Visit the root node of the AST to generate IR
             Tree->accept(*this);
@@ -72,58 +423,18 @@ namespace
             Builder.CreateRet(Int32Zero);
         }
 
-        virtual void visit(Base &Node) override
+        virtual void visit(::Base &Node) override
         {
             // TODO: find a better way to not implement this again!
             for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
             {
-                (*I)->accept(*this);
-            }
-        }
-
-        virtual void visit(Statement &Node) override
-        {
-            // TODO: find a better way to not implement this again!
-            if (Node.getKind() == Statement::StatementType::Declaration)
-            {
-                DecStatement *declaration = (DecStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Assignment)
-            {
-                AssignStatement *declaration = (AssignStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::If)
-            {
-                IfStatement *declaration = (IfStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::ElseIf)
-            {
-                ElseIfStatement *declaration = (ElseIfStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Else)
-            {
-                ElseStatement *declaration = (ElseStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Print)
-            {
-                PrintStatement *declaration = (PrintStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::While)
-            {
-                WhileStatement *declaration = (WhileStatement *)&Node;
-                declaration->accept(*this);
+                dispatch(**I);
             }
         }
 
         virtual void visit(PrintStatement &Node) override {
             // Visit the right-hand side of the expression and get its value.
-            Node.getExpr()->accept(*this);
+            dispatch(*Node.getExpr());
             Value *val = V;
 
             // Determine the type of 'val' and select the appropriate print function
@@ -142,12 +453,11 @@ namespace
         {
             if (Node.getKind() == Expression::ExpressionType::Identifier)
             {
-                AllocaInst *allocaInst = nameMap[Node.getValue()];
-                if (!allocaInst) {
+                if (!VarTypes[Node.getSymbol()]) {
                    llvm::errs() << "Undefined variable '" << Node.getValue() << "'\n";
                     return;
                 }
-                V = Builder.CreateLoad(allocaInst->getAllocatedType(), allocaInst, Node.getValue());
+                V = readVariable(Node.getSymbol(), Builder.GetInsertBlock());
             }
             else if (Node.getKind() == Expression::ExpressionType::Number)
             {
@@ -163,12 +473,20 @@ namespace
 
         virtual void visit(BooleanOp &Node) override
         {
+            bool isLogical = Node.getOperator() == BooleanOp::And || Node.getOperator() == BooleanOp::Or;
+            unsigned Budget = 8;
+            if (isLogical && !isCheapExpression(Node.getRight(), Budget))
+            {
+                createShortCircuit(Node);
+                return;
+            }
+
             // Visit the left-hand side of the binary operation and get its value
-            Node.getLeft()->accept(*this);
+            dispatch(*Node.getLeft());
             Value *Left = V;
 
             // Visit the right-hand side of the binary operation and get its value
-            Node.getRight()->accept(*this);
+            dispatch(*Node.getRight());
             Value *Right = V;
 
             // Perform the boolean operation based on the operator type and create the corresponding instruction
@@ -201,69 +519,218 @@ namespace
             }
         }
 
+        // Square-and-multiply for Base ^ Exp, a non-positive exponent gives 1.
+        // Constant exponents become a straight chain of multiplications,
+        // anything else a loop over the exponent bits.
+        Value *createPow(Value *Base, Value *Exp)
+        {
+            Constant *One = ConstantInt::get(Int32Ty, 1, true);
+            if (ConstantInt *ConstExp = dyn_cast<ConstantInt>(Exp))
+            {
+                int64_t E = ConstExp->getSExtValue();
+                if (E <= 0)
+                    return One;
+
+                // the top bit is Base itself, walk the remaining bits downwards
+                Value *Result = Base;
+                for (int Bit = 30 - (int)countLeadingZeros((uint32_t)E); Bit >= 0; --Bit)
+                {
+                    Result = Builder.CreateMul(Result, Result, "pow.sq");
+                    if ((E >> Bit) & 1)
+                        Result = Builder.CreateMul(Result, Base, "pow.mul");
+                }
+                return Result;
+            }
+
+            BasicBlock *PreBB = Builder.GetInsertBlock();
+            BasicBlock *CondBB = BasicBlock::Create(M->getContext(), "pow.cond", MainFn);
+            BasicBlock *BodyBB = BasicBlock::Create(M->getContext(), "pow.body", MainFn);
+            BasicBlock *AfterBB = BasicBlock::Create(M->getContext(), "pow.end", MainFn);
+            Builder.CreateBr(CondBB);
+
+            Builder.SetInsertPoint(CondBB);
+            PHINode *Result = Builder.CreatePHI(Int32Ty, 2, "pow.result");
+            PHINode *Square = Builder.CreatePHI(Int32Ty, 2, "pow.base");
+            PHINode *Rest = Builder.CreatePHI(Int32Ty, 2, "pow.exp");
+            Result->addIncoming(One, PreBB);
+            Square->addIncoming(Base, PreBB);
+            Rest->addIncoming(Exp, PreBB);
+            Builder.CreateCondBr(Builder.CreateICmpSGT(Rest, Int32Zero), BodyBB, AfterBB);
+            sealBlock(BodyBB);
+            sealBlock(AfterBB);
+
+            // multiplications wrap like the constant chain, the last squaring may overflow unused
+            Builder.SetInsertPoint(BodyBB);
+            Value *Odd = Builder.CreateICmpNE(Builder.CreateAnd(Rest, One), Int32Zero);
+            Value *Product = Builder.CreateMul(Result, Square, "pow.mul");
+            Result->addIncoming(Builder.CreateSelect(Odd, Product, Result), BodyBB);
+            Square->addIncoming(Builder.CreateMul(Square, Square, "pow.sq"), BodyBB);
+            Rest->addIncoming(Builder.CreateAShr(Rest, One), BodyBB);
+            Builder.CreateBr(CondBB);
+            sealBlock(CondBB);
+
+            Builder.SetInsertPoint(AfterBB);
+            return Result;
+        }
+
+        // Signed division by a constant without sdiv: a shift sequence for
+        // powers of two and a multiply-high by the magic number otherwise.
+        // Returns nullptr when Right is not a suitable constant.
+        Value *createDivByConstant(Value *Left, Value *Right)
+        {
+            ConstantInt *Divisor = dyn_cast<ConstantInt>(Right);
+            if (!Divisor || isa<Constant>(Left))
+                return nullptr;
+            APInt D = Divisor->getValue();
+            // |d| <= 1 and INT_MIN are left to sdiv
+            if (D.isMinSignedValue() || D.abs().ule(1))
+                return nullptr;
+
+            APInt AbsD = D.abs();
+            Value *Quotient;
+            if (AbsD.isPowerOf2())
+            {
+                // round towards zero: add 2^k - 1 to negative dividends before shifting
+                unsigned Shift = AbsD.logBase2();
+                Value *Sign = Builder.CreateAShr(Left, 31);
+                Value *Bias = Builder.CreateLShr(Sign, 32 - Shift);
+                Quotient = Builder.CreateAShr(Builder.CreateAdd(Left, Bias), Shift);
+            }
+            else
+            {
+                SignedDivisionByConstantInfo Magic = SignedDivisionByConstantInfo::get(D);
+                Type *Int64Ty = Type::getInt64Ty(M->getContext());
+                Value *Wide = Builder.CreateMul(Builder.CreateSExt(Left, Int64Ty),
+                                                ConstantInt::get(Int64Ty, Magic.Magic.sext(64)));
+                Quotient = Builder.CreateTrunc(Builder.CreateAShr(Wide, 32), Int32Ty);
+                if (D.isStrictlyPositive() && Magic.Magic.isNegative())
+                    Quotient = Builder.CreateAdd(Quotient, Left);
+                else if (D.isNegative() && Magic.Magic.isStrictlyPositive())
+                    Quotient = Builder.CreateSub(Quotient, Left);
+                if (Magic.ShiftAmount)
+                    Quotient = Builder.CreateAShr(Quotient, Magic.ShiftAmount);
+                // add one for negative quotients to round towards zero
+                Quotient = Builder.CreateAdd(Quotient, Builder.CreateLShr(Quotient, 31));
+                return Quotient;
+            }
+            return D.isNegative() ? Builder.CreateNeg(Quotient) : Quotient;
+        }
+
+        // IRBuilder folds a division that is known to trap to poison, so
+        // those call llvm.trap instead, as the sdiv or srem would at runtime
+        Value *createKnownTrap(Value *Left, Value *Right)
+        {
+            ConstantInt *Divisor = dyn_cast<ConstantInt>(Right);
+            ConstantInt *Dividend = dyn_cast<ConstantInt>(Left);
+            if (!Divisor || !(Divisor->isZero() || (Divisor->isMinusOne() && Dividend && Dividend->isMinValue(true))))
+                return nullptr;
+            Builder.CreateCall(Intrinsic::getDeclaration(M, Intrinsic::trap));
+            return ConstantInt::get(Int32Ty, 0);
+        }
+
+        Value *createDiv(Value *Left, Value *Right)
+        {
+            if (Value *Trap = createKnownTrap(Left, Right))
+                return Trap;
+            if (Value *Quotient = createDivByConstant(Left, Right))
+                return Quotient;
+            return Builder.CreateSDiv(Left, Right);
+        }
+
+        Value *createRem(Value *Left, Value *Right)
+        {
+            if (Value *Trap = createKnownTrap(Left, Right))
+                return Trap;
+            ConstantInt *Divisor = dyn_cast<ConstantInt>(Right);
+            if (Divisor && !isa<Constant>(Left) && Divisor->getValue().abs().isPowerOf2() &&
+                !Divisor->getValue().isMinSignedValue() && Divisor->getValue().abs().ugt(1))
+            {
+                // n - ((n + bias) & -2^k), the remainder keeps the sign of n
+                unsigned Shift = Divisor->getValue().abs().logBase2();
+                Value *Bias = Builder.CreateLShr(Builder.CreateAShr(Left, 31), 32 - Shift);
+                Value *Rounded = Builder.CreateAnd(Builder.CreateAdd(Left, Bias), -(1 << Shift));
+                return Builder.CreateSub(Left, Rounded);
+            }
+            if (Value *Quotient = createDivByConstant(Left, Right))
+                return Builder.CreateSub(Left, Builder.CreateMul(Quotient, Right));
+            return Builder.CreateSRem(Left, Right);
+        }
+
+        // `and`/`or` that only evaluates the right operand when the left one
+        // does not decide the result already
+        void createShortCircuit(BooleanOp &Node)
+        {
+            bool isAnd = Node.getOperator() == BooleanOp::And;
+            dispatch(*Node.getLeft());
+            Value *Left = V;
+            BasicBlock *LeftBB = Builder.GetInsertBlock();
+
+            BasicBlock *RightBB = BasicBlock::Create(M->getContext(), isAnd ? "and.rhs" : "or.rhs", MainFn);
+            BasicBlock *AfterBB = BasicBlock::Create(M->getContext(), isAnd ? "and.end" : "or.end", MainFn);
+            if (isAnd)
+                Builder.CreateCondBr(Left, RightBB, AfterBB);
+            else
+                Builder.CreateCondBr(Left, AfterBB, RightBB);
+            sealBlock(RightBB);
+
+            Builder.SetInsertPoint(RightBB);
+            dispatch(*Node.getRight());
+            Value *Right = V;
+            BasicBlock *RightEndBB = Builder.GetInsertBlock();
+            Builder.CreateBr(AfterBB);
+            sealBlock(AfterBB);
+
+            Builder.SetInsertPoint(AfterBB);
+            PHINode *Result = Builder.CreatePHI(Int1Ty, 2, isAnd ? "and.result" : "or.result");
+            Result->addIncoming(ConstantInt::getBool(Int1Ty, !isAnd), LeftBB);
+            Result->addIncoming(Right, RightEndBB);
+            V = Result;
+        }
+
         virtual void visit(BinaryOp &Node) override
         {
+            // `i % m` inside a for loop that maintains a rotating counter for it
+            if (Node.getOperator() == BinaryOp::Mod && !Counters.empty())
+            {
+                for (const RotatingCounter &Counter : Counters)
+                {
+                    if (getModulusOf(&Node, Counter.Symbol) == Counter.Modulus)
+                    {
+                        V = readVariable(Counter.Counter, Builder.GetInsertBlock());
+                        return;
+                    }
+                }
+            }
+
             // Visit the left-hand side of the binary operation and get its value
-            Node.getLeft()->accept(*this);
+            dispatch(*Node.getLeft());
             Value *Left = V;
 
             // Visit the right-hand side of the binary operation and get its value
-            Node.getRight()->accept(*this);
+            dispatch(*Node.getRight());
             Value *Right = V;
 
             // Perform the binary operation based on the operator type and create the corresponding instruction
             switch (Node.getOperator())
             {
             case BinaryOp::Plus:
-                V = Builder.CreateNSWAdd(Left, Right);
+                V = Builder.CreateAdd(Left, Right);
                 break;
             case BinaryOp::Minus:
-                V = Builder.CreateNSWSub(Left, Right);
+                V = Builder.CreateSub(Left, Right);
                 break;
             case BinaryOp::Mul:
-                V = Builder.CreateNSWMul(Left, Right);
+                V = Builder.CreateMul(Left, Right);
                 break;
             case BinaryOp::Div:
-                V = Builder.CreateSDiv(Left, Right);
+                V = createDiv(Left, Right);
                 break;
-            case BinaryOp::Pow:{
-                Function *func = Builder.GetInsertBlock()->getParent();
-                BasicBlock *preLoopBB = Builder.GetInsertBlock();
-                BasicBlock *loopBB = BasicBlock::Create(M->getContext(), "loop", func);
-                BasicBlock *afterLoopBB = BasicBlock::Create(M->getContext(), "afterloop", func);
-
-                // Setup loop entry
-                Builder.CreateBr(loopBB);
-                Builder.SetInsertPoint(loopBB);
-
-                // Create loop variables (PHI nodes)
-                PHINode *resultPhi = Builder.CreatePHI(Left->getType(), 2, "result");
-                resultPhi->addIncoming(Left, preLoopBB);
-
-                PHINode *indexPhi = Builder.CreatePHI(Type::getInt32Ty(M->getContext()), 2, "index");
-                indexPhi->addIncoming(ConstantInt::get(Type::getInt32Ty(M->getContext()), 0), preLoopBB);
-
-                // Perform multiplication
-                Value *updatedResult = Builder.CreateNSWMul(resultPhi, Left, "multemp");
-                Value *updatedIndex = Builder.CreateAdd(indexPhi, ConstantInt::get(Type::getInt32Ty(M->getContext()), 1), "indexinc");
-
-                // Exit condition
-                Value *condition = Builder.CreateICmpNE(updatedIndex, Right, "loopcond");
-                Builder.CreateCondBr(condition, loopBB, afterLoopBB);
-
-                // Update PHI nodes for the next iteration
-                resultPhi->addIncoming(updatedResult, loopBB);
-                indexPhi->addIncoming(updatedIndex, loopBB);
-
-                // Complete the loop
-                Builder.SetInsertPoint(afterLoopBB);
-                V = resultPhi; // The result of a^b
+            case BinaryOp::Pow:
+                V = createPow(Left, Right);
                 break;
-            }
             case BinaryOp::Mod:
-                Value *division = Builder.CreateSDiv(Left, Right);
-                Value *multiplication = Builder.CreateNSWMul(division, Right);
-                V = Builder.CreateNSWSub(Left, multiplication);
+                V = createRem(Left, Right);
+                break;
             }
         }
 
@@ -274,156 +741,103 @@ namespace
             if (Node.getRValue() != nullptr)
             {
                 // If there is an expression provided, visit it and get its value
-                Node.getRValue()->accept(*this);
+                dispatch(*Node.getRValue());
                 val = V;
             }
 
             // Iterate over the variables declared in the declaration statement
-            auto I = Node.getLValue()->getValue();
-            StringRef Var = I;
+            unsigned Var = Node.getLValue()->getSymbol();
 
-            // Create an alloca instruction to allocate memory for the variable
             Type *varType = (Node.getDecType() == DecStatement::DecStatementType::Number) ? Int32Ty : Type::getInt1Ty(M->getContext());
-            nameMap[Var] = Builder.CreateAlloca(varType);
+            VarTypes[Var] = varType;
 
-            // Store the initial value (if any) in the variable's memory location
-            if (val != nullptr)
-            {
-                Builder.CreateStore(val, nameMap[Var]);
-            }
-            else
-            {
-                if(Node.getDecType() == DecStatement::DecStatementType::Number){
-                    Value *Zero = ConstantInt::get(Type::getInt32Ty(M->getContext()), 0);
-                    Builder.CreateStore(Zero, nameMap[Var]);
-                } else{
-                    Value *False = ConstantInt::get(Type::getInt1Ty(M->getContext()), 0);
-                    Builder.CreateStore(False, nameMap[Var]);
-                }
-                
-            }
+            // Define the variable with its initial value, zero or false if there is none
+            if (val == nullptr)
+                val = Constant::getNullValue(varType);
+            writeVariable(Var, Builder.GetInsertBlock(), val);
         }
 
         virtual void visit(AssignStatement &Node) override
         {
             // Visit the right-hand side of the assignment and get its value
-            Node.getRValue()->accept(*this);
+            dispatch(*Node.getRValue());
             Value *val = V;
 
             // Get the name of the variable being assigned
-            auto varName = Node.getLValue()->getValue();
+            unsigned varName = Node.getLValue()->getSymbol();
 
-            // Create a store instruction to assign the value to the variable
-            Builder.CreateStore(val, nameMap[varName]);
+            // The value becomes the current definition of the variable
+            writeVariable(varName, Builder.GetInsertBlock(), val);
         }
 
-        virtual void visit(IfStatement &Node) override
+        // fills a freshly targeted branch block and jumps to AfterBB
+        void emitBranchBody(BasicBlock *BB, llvm::ArrayRef<Statement *> Stmts, BasicBlock *AfterBB)
         {
-            llvm::BasicBlock *IfCondBB = llvm::BasicBlock::Create(M->getContext(), "if.cond", MainFn);
-            llvm::BasicBlock *IfBodyBB = llvm::BasicBlock::Create(M->getContext(), "if.body", MainFn);
-            llvm::BasicBlock *AfterIfBB = llvm::BasicBlock::Create(M->getContext(), "after.if", MainFn);
+            sealBlock(BB);
+            Builder.SetInsertPoint(BB);
+            for (Statement *Stmt : Stmts)
+                dispatch(*Stmt);
+            Builder.CreateBr(AfterBB);
+        }
 
-            Builder.CreateBr(IfCondBB);
-            Builder.SetInsertPoint(IfCondBB);
+        virtual void visit(IfStatement &Node) override
+        {
+            // Every conditional branch is created before the blocks it targets
+            // are filled, so each block can be sealed as soon as it is entered.
+            llvm::BasicBlock *AfterIfBB = llvm::BasicBlock::Create(M->getContext(), "after.if");
 
-            Node.getCondition()->accept(*this);
+            dispatch(*Node.getCondition());
             Value *Cond = V;
+            llvm::BasicBlock *BodyBB = llvm::BasicBlock::Create(M->getContext(), "if.body", MainFn);
+            llvm::ArrayRef<Statement *> Body = Node.getStatements();
 
-            Builder.SetInsertPoint(IfBodyBB);
-
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-
-            Builder.CreateBr(AfterIfBB);
-            llvm::BasicBlock *BeforeCondBB = IfCondBB;
-            llvm::BasicBlock *BeforeBodyBB = IfBodyBB;
-            llvm::Value *BeforeCondVal = Cond;
-
-            if (Node.HasElseIf())
+            for (ElseIfStatement *elseIf : Node.getElseIfStatements())
             {
-                for (auto &elseIf : Node.getElseIfStatements())
-                {
-                    llvm::BasicBlock *ElseIfCondBB = llvm::BasicBlock::Create(MainFn->getContext(), "elseIf.cond", MainFn);
-                    llvm::BasicBlock *ElseIfBodyBB = llvm::BasicBlock::Create(MainFn->getContext(), "elseIf.body", MainFn);
-
-                    Builder.SetInsertPoint(BeforeCondBB);
-                    Builder.CreateCondBr(BeforeCondVal, BeforeBodyBB, ElseIfCondBB);
-
-                    Builder.SetInsertPoint(ElseIfCondBB);
-                    elseIf->getCondition()->accept(*this);
-                    llvm::Value *ElseIfCondVal = V;
-
-                    Builder.SetInsertPoint(ElseIfBodyBB);
-                    elseIf->accept(*this);
-                    Builder.CreateBr(AfterIfBB);
-
-                    BeforeCondBB = ElseIfCondBB;
-                    BeforeCondVal = ElseIfCondVal;
-                    BeforeBodyBB = ElseIfBodyBB;
-                }
-                // finishing the last else
-                // Builder.CreateCondBr(BeforeCondVal, BeforeBodyBB, AfterIfBB);
+                llvm::BasicBlock *ElseIfCondBB = llvm::BasicBlock::Create(M->getContext(), "elseIf.cond", MainFn);
+                Builder.CreateCondBr(Cond, BodyBB, ElseIfCondBB);
+                emitBranchBody(BodyBB, Body, AfterIfBB);
+
+                sealBlock(ElseIfCondBB);
+                Builder.SetInsertPoint(ElseIfCondBB);
+                dispatch(*elseIf->getCondition());
+                Cond = V;
+                BodyBB = llvm::BasicBlock::Create(M->getContext(), "elseIf.body", MainFn);
+                Body = elseIf->getStatements();
             }
 
-
-            llvm::BasicBlock *ElseBB = nullptr;
+            llvm::BasicBlock *ElseBB = AfterIfBB;
             if (Node.HasElse())
-            {
-                ElseStatement *elseS = Node.getElseStatement();
-                ElseBB = llvm::BasicBlock::Create(MainFn->getContext(), "else.body", MainFn);
-                if(Node.HasElseIf()){
-                    Builder.SetInsertPoint(BeforeCondBB);
-                    Builder.CreateCondBr(BeforeCondVal, BeforeBodyBB, ElseBB);
-                }
-                Builder.SetInsertPoint(ElseBB);
-                Node.getElseStatement()->accept(*this);
-                Builder.CreateBr(AfterIfBB);
-            }
-            else
-            {
-                Builder.SetInsertPoint(BeforeCondBB);
-                if(Node.HasElseIf()){
-                    Builder.CreateCondBr(BeforeCondVal, BeforeBodyBB, AfterIfBB);
-                }else{
-                    Builder.CreateCondBr(Cond, IfBodyBB, AfterIfBB);
-                }
-                
-            }
+                ElseBB = llvm::BasicBlock::Create(M->getContext(), "else.body", MainFn);
+            Builder.CreateCondBr(Cond, BodyBB, ElseBB);
+            emitBranchBody(BodyBB, Body, AfterIfBB);
+            if (Node.HasElse())
+                emitBranchBody(ElseBB, Node.getElseStatement()->getStatements(), AfterIfBB);
 
+            AfterIfBB->insertInto(MainFn);
+            sealBlock(AfterIfBB);
             Builder.SetInsertPoint(AfterIfBB);
         }
 
         virtual void visit(ElseIfStatement &Node) override
         {
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
+            llvm::ArrayRef<Statement *> stmts = Node.getStatements();
             for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
             {
-                (*I)->accept(*this);
+                dispatch(**I);
             }
         }
 
         virtual void visit(ElseStatement &Node) override
         {
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
+            llvm::ArrayRef<Statement *> stmts = Node.getStatements();
             for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
             {
-                (*I)->accept(*this);
+                dispatch(**I);
             }
         }
 
         virtual void visit(WhileStatement &Node) override
         {
-            if (optimize && !Node.isOptimized()) {
-                llvm::SmallVector<Statement*> unrolledStatements = completeUnroll(&Node, k);
-                for (auto I = unrolledStatements.begin(), E = unrolledStatements.end(); I != E; ++I)
-                    {
-                        (*I)->accept(*this);
-                    }
-                return;
-            }
             llvm::BasicBlock* WhileCondBB = llvm::BasicBlock::Create(M->getContext(), "while.cond", MainFn);
             // The basic block for the while body.
             llvm::BasicBlock* WhileBodyBB = llvm::BasicBlock::Create(M->getContext(), "while.body", MainFn);
@@ -437,34 +851,29 @@ namespace
             Builder.SetInsertPoint(WhileCondBB);
 
             // Visit the condition expression and create the conditional branch.
-            Node.getCondition()->accept(*this);
+            dispatch(*Node.getCondition());
             Value* Cond = V;
             Builder.CreateCondBr(Cond, WhileBodyBB, AfterWhileBB);
+            sealBlock(WhileBodyBB);
+            sealBlock(AfterWhileBB);
 
             // Set the insertion point to the body block.
             Builder.SetInsertPoint(WhileBodyBB);
 
-            llvm::SmallVector<Statement* > stmts = Node.getStatements();
+            llvm::ArrayRef<Statement *> stmts = Node.getStatements();
             for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
             {
-                (*I)->accept(*this);
+                dispatch(**I);
             }
 
-            // Branch back to the condition block.
+            // Branch back to the condition block, its predecessors are complete now
             Builder.CreateBr(WhileCondBB);
+            sealBlock(WhileCondBB);
             // Set the insertion point to the block after the while loop.
             Builder.SetInsertPoint(AfterWhileBB);
         }
         virtual void visit(ForStatement &Node) override
         {
-            if (optimize && !Node.isOptimized()) {
-                llvm::SmallVector<Statement*> unrolledStatements = completeUnroll(&Node, k);
-                for (auto I = unrolledStatements.begin(), E = unrolledStatements.end(); I != E; ++I)
-                    {
-                        (*I)->accept(*this);
-                    }
-                return;
-            }
             llvm::BasicBlock* ForCondBB = llvm::BasicBlock::Create(M->getContext(), "for.cond", MainFn);
             // The basic block for the while body.
             llvm::BasicBlock* ForBodyBB = llvm::BasicBlock::Create(M->getContext(), "for.body", MainFn);
@@ -474,15 +883,37 @@ namespace
             llvm::BasicBlock* ForUpdateBB = llvm::BasicBlock::Create(M->getContext(), "for.update", MainFn);
 
             AssignStatement * initial_assign = Node.getInitialAssign();
-            ((Expression *)initial_assign->getRValue())->accept(*this);
+            dispatch(*initial_assign->getRValue());
             Value *val = V;
 
             // Get the name of the variable being assigned
-            auto varName = ((Expression *)initial_assign->getLValue())->getValue();
-
-            // Create a store instruction to assign the value to the variable
-            Builder.CreateStore(val, nameMap[varName]);
-
+            unsigned varName = initial_assign->getLValue()->getSymbol();
+
+            // The initial value becomes the current definition of the variable
+            writeVariable(varName, Builder.GetInsertBlock(), val);
+
+            // For `i = c0; i < c; i = i + step` with c0 >= 0 and step > 0, where
+            // the body never writes i and i cannot wrap past INT_MAX, every
+            // `i % m` is replaced by a counter that starts at c0 % m and wraps
+            // around at m.
+            size_t OuterCounters = Counters.size();
+            int32_t Step = getConstantStep(Node.getUpdateAssign(), varName);
+            Expression *Start = initial_assign->getRValue();
+            if (Step > 0 && Start->getKind() == Expression::ExpressionType::Number && Start->getNumber() >= 0 &&
+                hasBoundedTrips(Node.getCondition(), varName, Start->getNumber(), Step) &&
+                !assignsSymbol(Node.getStatements(), varName))
+            {
+                llvm::SmallVector<int32_t, 4> Moduli;
+                collectModuli(Node.getCondition(), varName, Moduli);
+                collectModuli(Node.getStatements(), varName, Moduli);
+                for (int32_t Modulus : Moduli)
+                {
+                    unsigned Counter = createTemporary(Int32Ty, "mod.counter");
+                    writeVariable(Counter, Builder.GetInsertBlock(), ConstantInt::get(Int32Ty, Start->getNumber() % Modulus, true));
+                    Counters.push_back({varName, Modulus, Counter});
+                }
+            }
+            size_t LoopCounters = Counters.size();
 
             // Branch to the condition block.
             Builder.CreateBr(ForCondBB);
@@ -491,35 +922,52 @@ namespace
             Builder.SetInsertPoint(ForCondBB);
 
             // Visit the condition expression and create the conditional branch.
-            Node.getCondition()->accept(*this);
+            dispatch(*Node.getCondition());
             Value* Cond = V;
             Builder.CreateCondBr(Cond, ForBodyBB, AfterForBB);
+            sealBlock(ForBodyBB);
+            sealBlock(AfterForBB);
 
             // Set the insertion point to the body block.
             Builder.SetInsertPoint(ForBodyBB);
 
-            llvm::SmallVector<Statement* > stmts = Node.getStatements();
+            llvm::ArrayRef<Statement *> stmts = Node.getStatements();
             for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
             {
-                (*I)->accept(*this);
+                dispatch(**I);
             }
 
             Builder.CreateBr(ForUpdateBB);
+            sealBlock(ForUpdateBB);
 
             Builder.SetInsertPoint(ForUpdateBB);
 
             AssignStatement * update_assign = Node.getUpdateAssign();
-            ((Expression *)update_assign->getRValue())->accept(*this);
+            dispatch(*update_assign->getRValue());
             val = V;
 
             // Get the name of the variable being assigned
-            varName = ((Expression *)update_assign->getLValue())->getValue();
+            varName = update_assign->getLValue()->getSymbol();
 
-            // Create a store instruction to assign the value to the variable
-            Builder.CreateStore(val, nameMap[varName]);
+            // The updated value becomes the current definition of the variable
+            writeVariable(varName, Builder.GetInsertBlock(), val);
 
-            // Branch back to the condition block.
+            // advance the counters by step % m, at most one wrap per iteration
+            for (size_t I = OuterCounters; I != LoopCounters; ++I)
+            {
+                RotatingCounter &Counter = Counters[I];
+                Constant *Modulus = ConstantInt::get(Int32Ty, Counter.Modulus, true);
+                Value *Next = Builder.CreateAdd(readVariable(Counter.Counter, Builder.GetInsertBlock()),
+                                                ConstantInt::get(Int32Ty, Step % Counter.Modulus, true));
+                Value *Wrapped = Builder.CreateSelect(Builder.CreateICmpSGE(Next, Modulus),
+                                                      Builder.CreateSub(Next, Modulus), Next);
+                writeVariable(Counter.Counter, Builder.GetInsertBlock(), Wrapped);
+            }
+            Counters.resize(OuterCounters);
+
+            // Branch back to the condition block, its predecessors are complete now
             Builder.CreateBr(ForCondBB);
+            sealBlock(ForCondBB);
             // Set the insertion point to the block after the while loop.
             Builder.SetInsertPoint(AfterForBB);
         }
@@ -527,17 +975,109 @@ namespace
     
 }; // namespace
 
-void CodeGen::compile(AST *Tree, bool optimize, int k)
+std::unique_ptr<Module> CodeGen::compile(AST *Tree, ASTContext &Context, LLVMContext &Ctx)
 {
-    // Create an LLVM context and a module
-    LLVMContext Ctx;
-    Module *M = new Module("mas.expr", Ctx);
+    // Create a module in the caller's LLVM context
+    std::unique_ptr<Module> M = std::make_unique<Module>("mas.expr", Ctx);
 
     // Create an instance of the ToIRVisitor and run it on the AST to generate LLVM IR
-    ToIRVisitor ToIRn(M, optimize, k);
+    ToIRVisitor ToIRn(M.get(), Context);
 
     ToIRn.run(Tree);
 
-    // Print the generated module to the standard output
-    M->print(outs(), nullptr);
+    // The IR no longer refers to the tree, release all nodes at once
+    Context.reset();
+
+    return M;
+}
+
+TargetMachine *CodeGen::getTargetMachine(unsigned Level)
+{
+    if (TM)
+        return TM.get();
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    std::string Triple = sys::getDefaultTargetTriple();
+    std::string Error;
+    const Target *TheTarget = TargetRegistry::lookupTarget(Triple, Error);
+    if (!TheTarget)
+    {
+        errs() << "Error looking up target: " << Error << "\n";
+        return nullptr;
+    }
+
+    // position independent code so the object links into a default PIE executable
+    TM.reset(TheTarget->createTargetMachine(
+        Triple, sys::getHostCPUName(), "", TargetOptions(), Reloc::PIC_, None, getCodeGenLevel(Level)));
+    return TM.get();
+}
+
+void CodeGen::setTarget(Module &M, TargetMachine &Machine)
+{
+    M.setTargetTriple(Machine.getTargetTriple().str());
+    M.setDataLayout(Machine.createDataLayout());
+}
+
+void CodeGen::optimizeModule(Module &M, unsigned Level)
+{
+    if (Level == 0)
+        return;
+
+    // the cost models of the passes need the host's layout and target info
+    TargetMachine *Machine = getTargetMachine(Level);
+    if (Machine)
+        setTarget(M, *Machine);
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+
+    PassBuilder PB(Machine);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    OptimizationLevel OptLevel = Level == 1   ? OptimizationLevel::O1
+                                 : Level == 2 ? OptimizationLevel::O2
+                                              : OptimizationLevel::O3;
+    ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(OptLevel);
+    MPM.run(M, MAM);
+}
+
+CodeGenOpt::Level CodeGen::getCodeGenLevel(unsigned Level)
+{
+    return Level == 0 ? CodeGenOpt::None : Level == 1 ? CodeGenOpt::Less
+                                       : Level == 2   ? CodeGenOpt::Default
+                                                      : CodeGenOpt::Aggressive;
+}
+
+bool CodeGen::emitObject(Module &M, StringRef FileName, unsigned Level)
+{
+    TargetMachine *Machine = getTargetMachine(Level);
+    if (!Machine)
+        return true;
+    setTarget(M, *Machine);
+
+    std::error_code EC;
+    raw_fd_ostream Out(FileName, EC, sys::fs::OF_None);
+    if (EC)
+    {
+        errs() << "Error opening " << FileName << ": " << EC.message() << "\n";
+        return true;
+    }
+
+    legacy::PassManager PM;
+    if (Machine->addPassesToEmitFile(PM, Out, nullptr, CGFT_ObjectFile))
+    {
+        errs() << "Target cannot emit object files\n";
+        return true;
+    }
+    PM.run(M);
+    Out.flush();
+    return false;
 }
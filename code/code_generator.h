@@ -2,10 +2,32 @@
 #define CODEGEN_H
 
 #include "AST.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
 
 class CodeGen
 {
+	// host target, created on first use at the -O level of that use
+	std::unique_ptr<llvm::TargetMachine> TM;
+
+	llvm::TargetMachine *getTargetMachine(unsigned Level);
+	static void setTarget(llvm::Module &M, llvm::TargetMachine &Machine);
+
 public:
-	void compile(AST *Tree, bool optimize, int k);
+	// builds the module for Tree and releases the tree afterwards
+	std::unique_ptr<llvm::Module> compile(AST *Tree, ASTContext &Context, llvm::LLVMContext &Ctx);
+
+	// runs the standard new pass manager pipeline for -O<Level> on M with the
+	// host's target triple and data layout, 0 leaves it untouched
+	void optimizeModule(llvm::Module &M, unsigned Level);
+
+	// machine code optimization level matching -O<Level>
+	static llvm::CodeGenOpt::Level getCodeGenLevel(unsigned Level);
+
+	// writes M as a native object file for the host to FileName, returns true on error
+	bool emitObject(llvm::Module &M, llvm::StringRef FileName, unsigned Level);
 };
 #endif
@@ -0,0 +1,144 @@
+#include "flat_ast.h"
+
+uint32_t FlatAST::addNode(NodeKind Kind, uint8_t Op, int32_t Value)
+{
+    uint32_t Node = size();
+    Kinds.push_back(Kind);
+    Ops.push_back(Op);
+    Ends.push_back(Node + 1);
+    Values.push_back(Value);
+    return Node;
+}
+
+void FlatAST::addExpression(Expression *Expr)
+{
+    switch (Expr->getKind())
+    {
+    case Expression::ExpressionType::Number:
+        addNode(NumberNode, 0, Expr->getNumber());
+        break;
+    case Expression::ExpressionType::Identifier:
+        addNode(IdentifierNode, 0, Expr->getSymbol());
+        break;
+    case Expression::ExpressionType::Boolean:
+        addNode(BooleanNode, 0, Expr->getBoolean());
+        break;
+    case Expression::ExpressionType::BinaryOpType:
+    {
+        BinaryOp *binaryOp = (BinaryOp *)Expr;
+        uint32_t Node = addNode(BinaryOpNode, binaryOp->getOperator(), 0);
+        addExpression(binaryOp->getLeft());
+        addExpression(binaryOp->getRight());
+        finishNode(Node);
+        break;
+    }
+    case Expression::ExpressionType::BooleanOpType:
+    {
+        BooleanOp *booleanOp = (BooleanOp *)Expr;
+        uint32_t Node = addNode(BooleanOpNode, booleanOp->getOperator(), 0);
+        addExpression(booleanOp->getLeft());
+        addExpression(booleanOp->getRight());
+        finishNode(Node);
+        break;
+    }
+    }
+}
+
+void FlatAST::addStatements(llvm::ArrayRef<Statement *> Stmts)
+{
+    for (Statement *Stmt : Stmts)
+        addStatement(Stmt);
+}
+
+void FlatAST::addStatement(Statement *Stmt)
+{
+    switch (Stmt->getKind())
+    {
+    case Statement::StatementType::Declaration:
+    {
+        DecStatement *declaration = (DecStatement *)Stmt;
+        uint32_t Node = addNode(DeclNode, declaration->getDecType(), 0);
+        addExpression(declaration->getLValue());
+        if (declaration->getRValue())
+            addExpression(declaration->getRValue());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::Assignment:
+    {
+        AssignStatement *assignment = (AssignStatement *)Stmt;
+        uint32_t Node = addNode(AssignNode, 0, 0);
+        addExpression(assignment->getLValue());
+        addExpression(assignment->getRValue());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::Print:
+    {
+        uint32_t Node = addNode(PrintNode, 0, 0);
+        addExpression(((PrintStatement *)Stmt)->getExpr());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::If:
+    {
+        IfStatement *ifStatement = (IfStatement *)Stmt;
+        uint32_t Node = addNode(IfNode, 0, 0);
+        addExpression(ifStatement->getCondition());
+        addStatements(ifStatement->getStatements());
+        for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+            addStatement(elseIf);
+        if (ifStatement->HasElse())
+            addStatement(ifStatement->getElseStatement());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::ElseIf:
+    {
+        ElseIfStatement *elseIf = (ElseIfStatement *)Stmt;
+        uint32_t Node = addNode(ElseIfNode, 0, 0);
+        addExpression(elseIf->getCondition());
+        addStatements(elseIf->getStatements());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::Else:
+    {
+        uint32_t Node = addNode(ElseNode, 0, 0);
+        addStatements(((ElseStatement *)Stmt)->getStatements());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::While:
+    {
+        WhileStatement *whileStatement = (WhileStatement *)Stmt;
+        uint32_t Node = addNode(WhileNode, 0, 0);
+        addExpression(whileStatement->getCondition());
+        addStatements(whileStatement->getStatements());
+        finishNode(Node);
+        break;
+    }
+    case Statement::StatementType::For:
+    {
+        ForStatement *forStatement = (ForStatement *)Stmt;
+        uint32_t Node = addNode(ForNode, 0, 0);
+        addExpression(forStatement->getInitialAssign()->getLValue());
+        addExpression(forStatement->getInitialAssign()->getRValue());
+        addExpression(forStatement->getCondition());
+        addExpression(forStatement->getUpdateAssign()->getLValue());
+        addExpression(forStatement->getUpdateAssign()->getRValue());
+        addStatements(forStatement->getStatements());
+        finishNode(Node);
+        break;
+    }
+    }
+}
+
+void FlatAST::build(Base *Tree)
+{
+    Kinds.clear();
+    Ops.clear();
+    Ends.clear();
+    Values.clear();
+    addStatements(Tree->getStatements());
+}
@@ -0,0 +1,62 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "AST.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include <cstdint>
+
+// Flat copy of the AST for passes that only need to read the tree.
+// Nodes are stored in pre-order in parallel arrays: the subtree of node I
+// occupies [I, getEnd(I)), its first child is I + 1 and every following
+// child starts at the end index of its previous sibling. Walking the arrays
+// from 0 to size() visits the program in source order without any pointer
+// chasing or virtual dispatch.
+class FlatAST
+{
+public:
+    enum NodeKind : uint8_t
+    {
+        NumberNode,     // Value: literal
+        IdentifierNode, // Value: symbol ID
+        BooleanNode,    // Value: 0 or 1
+        BinaryOpNode,   // Op: BinaryOp::Operator, children: left, right
+        BooleanOpNode,  // Op: BooleanOp::Operator, children: left, right
+        DeclNode,       // Op: DecStatement::DecStatementType, children: name [, value]
+        AssignNode,     // children: name, value
+        PrintNode,      // children: expression
+        IfNode,         // children: condition, statements..., else ifs..., else
+        ElseIfNode,     // children: condition, statements...
+        ElseNode,       // children: statements...
+        WhileNode,      // children: condition, statements...
+        ForNode         // children: init name, init value, condition, update name, update value, statements...
+    };
+
+private:
+    llvm::SmallVector<uint8_t, 0> Kinds;
+    llvm::SmallVector<uint8_t, 0> Ops;
+    llvm::SmallVector<uint32_t, 0> Ends;
+    llvm::SmallVector<int32_t, 0> Values;
+
+    uint32_t addNode(NodeKind Kind, uint8_t Op, int32_t Value);
+    void finishNode(uint32_t Node) { Ends[Node] = size(); }
+    void addExpression(Expression *Expr);
+    void addStatement(Statement *Stmt);
+    void addStatements(llvm::ArrayRef<Statement *> Stmts);
+
+public:
+    void build(Base *Tree);
+
+    uint32_t size() const { return Kinds.size(); }
+    NodeKind getKind(uint32_t Node) const { return (NodeKind)Kinds[Node]; }
+    uint8_t getOp(uint32_t Node) const { return Ops[Node]; }
+    uint32_t getEnd(uint32_t Node) const { return Ends[Node]; }
+    int32_t getValue(uint32_t Node) const { return Values[Node]; }
+    unsigned getSymbol(uint32_t Node) const { return Values[Node]; }
+
+    // index of the child following Child, equal to getEnd(parent) after the last one
+    uint32_t getNextSibling(uint32_t Child) const { return Ends[Child]; }
+    bool hasChild(uint32_t Parent, uint32_t Child) const { return Child < Ends[Parent]; }
+};
+
+#endif
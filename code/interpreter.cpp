@@ -0,0 +1,223 @@
+#include "interpreter.h"
+#include "flat_ast.h"
+#include "optimizer.h"
+#include "llvm/ADT/SmallVector.h"
+#include <vector>
+
+namespace
+{
+    // more output than this is cheaper to compute at runtime than to emit
+    const unsigned MaxOutputs = 1 << 16;
+
+    struct Output
+    {
+        int32_t Value;
+        bool IsBool;
+    };
+
+    class Interpreter
+    {
+        const FlatAST &Tree;
+        std::vector<int32_t> Vars;  // indexed by symbol ID
+        std::vector<char> BoolVars; // declared as bool
+        uint64_t Budget;
+        uint64_t Steps = 0;
+
+        bool step()
+        {
+            return ++Steps <= Budget;
+        }
+
+        bool isBoolExpression(uint32_t Node)
+        {
+            switch (Tree.getKind(Node))
+            {
+            case FlatAST::BooleanNode:
+            case FlatAST::BooleanOpNode:
+                return true;
+            case FlatAST::IdentifierNode:
+                return BoolVars[Tree.getSymbol(Node)];
+            default:
+                return false;
+            }
+        }
+
+        bool evaluate(uint32_t Node, int32_t &Result)
+        {
+            if (!step())
+                return false;
+            switch (Tree.getKind(Node))
+            {
+            case FlatAST::NumberNode:
+            case FlatAST::BooleanNode:
+                Result = Tree.getValue(Node);
+                return true;
+            case FlatAST::IdentifierNode:
+                Result = Vars[Tree.getSymbol(Node)];
+                return true;
+            case FlatAST::BinaryOpNode:
+            {
+                int32_t Left, Right;
+                return evaluate(Node + 1, Left) && evaluate(Tree.getNextSibling(Node + 1), Right) &&
+                       evaluateBinaryOp((BinaryOp::Operator)Tree.getOp(Node), Left, Right, Result);
+            }
+            case FlatAST::BooleanOpNode:
+            {
+                BooleanOp::Operator Op = (BooleanOp::Operator)Tree.getOp(Node);
+                int32_t Left, Right;
+                if (!evaluate(Node + 1, Left))
+                    return false;
+                // codegen only evaluates a right side that could trap when it is needed
+                if ((Op == BooleanOp::And && !Left) || (Op == BooleanOp::Or && Left))
+                {
+                    Result = Left;
+                    return true;
+                }
+                if (!evaluate(Tree.getNextSibling(Node + 1), Right))
+                    return false;
+                Result = evaluateComparison(Op, Left, Right);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        bool executeRange(uint32_t Begin, uint32_t End)
+        {
+            for (uint32_t Stmt = Begin; Stmt < End; Stmt = Tree.getNextSibling(Stmt))
+                if (!execute(Stmt))
+                    return false;
+            return true;
+        }
+
+        // statements of an if/else if run until its first else if or else child
+        uint32_t getBranchEnd(uint32_t Begin, uint32_t End)
+        {
+            while (Begin < End && Tree.getKind(Begin) != FlatAST::ElseIfNode && Tree.getKind(Begin) != FlatAST::ElseNode)
+                Begin = Tree.getNextSibling(Begin);
+            return Begin;
+        }
+
+        bool execute(uint32_t Node)
+        {
+            if (!step())
+                return false;
+            uint32_t End = Tree.getEnd(Node);
+            switch (Tree.getKind(Node))
+            {
+            case FlatAST::DeclNode:
+            {
+                unsigned Var = Tree.getSymbol(Node + 1);
+                BoolVars[Var] = Tree.getOp(Node) == DecStatement::DecStatementType::Boolean;
+                Vars[Var] = 0;
+                uint32_t Value = Tree.getNextSibling(Node + 1);
+                return Value == End || evaluate(Value, Vars[Var]);
+            }
+            case FlatAST::AssignNode:
+                return evaluate(Tree.getNextSibling(Node + 1), Vars[Tree.getSymbol(Node + 1)]);
+            case FlatAST::PrintNode:
+            {
+                int32_t Value;
+                if (!evaluate(Node + 1, Value) || Outputs.size() == MaxOutputs)
+                    return false;
+                Outputs.push_back({Value, isBoolExpression(Node + 1)});
+                return true;
+            }
+            case FlatAST::IfNode:
+            {
+                // the if itself and each else if: condition, then statements
+                for (uint32_t Branch = Node; Branch < End;)
+                {
+                    if (Tree.getKind(Branch) == FlatAST::ElseNode)
+                        return executeRange(Branch + 1, Tree.getEnd(Branch));
+                    uint32_t Cond = Branch + 1;
+                    uint32_t BranchEnd = Branch == Node ? End : Tree.getEnd(Branch);
+                    uint32_t Body = Tree.getNextSibling(Cond);
+                    uint32_t BodyEnd = getBranchEnd(Body, BranchEnd);
+                    int32_t Taken;
+                    if (!evaluate(Cond, Taken))
+                        return false;
+                    if (Taken)
+                        return executeRange(Body, BodyEnd);
+                    Branch = Branch == Node ? BodyEnd : BranchEnd;
+                }
+                return true;
+            }
+            case FlatAST::WhileNode:
+            {
+                uint32_t Body = Tree.getNextSibling(Node + 1);
+                for (;;)
+                {
+                    int32_t Cond;
+                    if (!evaluate(Node + 1, Cond))
+                        return false;
+                    if (!Cond)
+                        return true;
+                    if (!executeRange(Body, End))
+                        return false;
+                }
+            }
+            case FlatAST::ForNode:
+            {
+                uint32_t InitName = Node + 1;
+                uint32_t InitValue = Tree.getNextSibling(InitName);
+                uint32_t Cond = Tree.getNextSibling(InitValue);
+                uint32_t UpdateName = Tree.getNextSibling(Cond);
+                uint32_t UpdateValue = Tree.getNextSibling(UpdateName);
+                uint32_t Body = Tree.getNextSibling(UpdateValue);
+                if (!evaluate(InitValue, Vars[Tree.getSymbol(InitName)]))
+                    return false;
+                for (;;)
+                {
+                    int32_t Taken;
+                    if (!evaluate(Cond, Taken))
+                        return false;
+                    if (!Taken)
+                        return true;
+                    if (!executeRange(Body, End) || !evaluate(UpdateValue, Vars[Tree.getSymbol(UpdateName)]))
+                        return false;
+                }
+            }
+            default:
+                return false;
+            }
+        }
+
+    public:
+        llvm::SmallVector<Output, 16> Outputs;
+
+        Interpreter(const FlatAST &Tree, unsigned NumSymbols, uint64_t Budget)
+            : Tree(Tree), Vars(NumSymbols, 0), BoolVars(NumSymbols, false), Budget(Budget) {}
+
+        bool run()
+        {
+            return executeRange(0, Tree.size());
+        }
+
+        uint64_t getSteps() { return Steps; }
+    };
+}
+
+bool evaluateProgram(ASTContext &Context, AST *Tree, uint64_t Budget, uint64_t &Steps)
+{
+    Base *Program = (Base *)Tree;
+    FlatAST Flat;
+    Flat.build(Program);
+
+    Interpreter Run(Flat, Context.getSymbols().size(), Budget);
+    bool Finished = Run.run();
+    Steps = Run.getSteps();
+    if (!Finished)
+        return false;
+
+    llvm::SmallVector<Statement *> Prints;
+    Prints.reserve(Run.Outputs.size());
+    for (const Output &Out : Run.Outputs)
+    {
+        Expression *Value = Out.IsBool ? Context.create<Expression>((bool)Out.Value) : Context.create<Expression>((int)Out.Value);
+        Prints.push_back(Context.create<PrintStatement>(Value));
+    }
+    Program->setStatements(std::move(Prints));
+    return true;
+}
@@ -0,0 +1,13 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "AST.h"
+#include <cstdint>
+
+// Runs the whole program at compile time. MAS programs read no input, so if
+// the run finishes within Budget steps (one per evaluated node) the tree is
+// replaced by print statements of the values it printed and true is
+// returned. Otherwise, or when the run would trap, the tree is left as is.
+bool evaluateProgram(ASTContext &Context, AST *Tree, uint64_t Budget, uint64_t &Steps);
+
+#endif
@@ -0,0 +1,65 @@
+#include "jit.h"
+#include "code_generator.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdio>
+
+// runtime from project_lib.c, linked into the compiler itself
+extern "C" void print(int v);
+extern "C" void printBool(int v);
+
+using namespace llvm;
+
+int runModule(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx, unsigned Level)
+{
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    auto JTMB = orc::JITTargetMachineBuilder::detectHost();
+    if (!JTMB)
+    {
+        errs() << "Error detecting host: " << toString(JTMB.takeError()) << "\n";
+        return 1;
+    }
+    // -O0 keeps the fast instruction selector and register allocator, some
+    // machine passes scale badly with one huge SSA main function
+    JTMB->setCodeGenOptLevel(CodeGen::getCodeGenLevel(Level));
+
+    auto JIT = orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(*JTMB)).create();
+    if (!JIT)
+    {
+        errs() << "Error creating JIT: " << toString(JIT.takeError()) << "\n";
+        return 1;
+    }
+
+    // resolve the runtime calls to this process instead of a shared library
+    orc::MangleAndInterner Mangle((*JIT)->getExecutionSession(), (*JIT)->getDataLayout());
+    orc::SymbolMap Runtime;
+    Runtime[Mangle("print")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&print), JITSymbolFlags::Exported);
+    Runtime[Mangle("printBool")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&printBool), JITSymbolFlags::Exported);
+    if (auto Err = (*JIT)->getMainJITDylib().define(orc::absoluteSymbols(std::move(Runtime))))
+    {
+        errs() << "Error binding runtime: " << toString(std::move(Err)) << "\n";
+        return 1;
+    }
+
+    M->setDataLayout((*JIT)->getDataLayout());
+    if (auto Err = (*JIT)->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    {
+        errs() << "Error adding module: " << toString(std::move(Err)) << "\n";
+        return 1;
+    }
+
+    auto MainSym = (*JIT)->lookup("main");
+    if (!MainSym)
+    {
+        errs() << "Error finding main: " << toString(MainSym.takeError()) << "\n";
+        return 1;
+    }
+
+    auto *Main = jitTargetAddressToFunction<int (*)(int, char **)>(MainSym->getAddress());
+    int Result = Main(0, nullptr);
+    fflush(stdout);
+    return Result;
+}
@@ -0,0 +1,13 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <memory>
+
+// Compiles the module in-process with ORC LLJIT, binds the print runtime of
+// project_lib.c and runs main. Returns main's exit code. Level is the -O level
+// that selects the machine code optimization level.
+int runModule(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> Ctx, unsigned Level);
+
+#endif
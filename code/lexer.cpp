@@ -1,6 +1,14 @@
 #include "lexer.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstdint>
+#include <cstring>
 #include <string>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXER_HAS_X86_SCAN 1
+#include <immintrin.h>
+#endif
+
 
 namespace charinfo
 {
@@ -36,38 +44,242 @@ namespace charinfo
 	}
 }
 
-void Lexer::next(Token &token)
+// Bulk scanners for the two loops that dominate on indented, heavily
+// commented sources. Vector versions only issue aligned loads, which never
+// cross a page boundary, so reading past the terminating 0 of the buffer
+// is safe; bytes before the start pointer are masked out.
+namespace scan
 {
-	// Skips whitespace like " "
-	while (*BufferPtr && charinfo::isWhitespace(*BufferPtr))
+	// first character at or after Ptr that is not whitespace (may be the 0)
+	const char *skipWhitespaceScalar(const char *Ptr)
 	{
-		++BufferPtr;
-	}
-	bool is_comment = false;
-	if (*BufferPtr == '/' && *(BufferPtr + 1) == '*'){
-		is_comment = true;
+		while (*Ptr && charinfo::isWhitespace(*Ptr))
+			++Ptr;
+		return Ptr;
 	}
-	while(is_comment){
-		if (!*BufferPtr)
+
+	// the '*' of the first "*/" at or after Start, or the terminating 0
+	const char *findCommentEndScalar(const char *Start)
+	{
+		for (const char *Ptr = Start; *Ptr; ++Ptr)
 		{
-			token.Kind = Token::eof;
-			return;
+			if (*Ptr == '/' && Ptr > Start && Ptr[-1] == '*')
+				return Ptr - 1;
 		}
-		while (*BufferPtr && *BufferPtr != '*' && *(BufferPtr + 1) != '/')
-		{
-			++BufferPtr;
+		return Start + strlen(Start);
+	}
+
+	// Candidates are '/' and 0 bytes; a '/' ends the comment when the byte
+	// before it is a '*' that belongs to the comment body.
+	inline const char *checkCommentCandidates(const char *Block, uint32_t Mask, const char *Start, bool &Found)
+	{
+		while (Mask)
+		{
+			const char *Ptr = Block + llvm::countTrailingZeros(Mask);
+			if (!*Ptr)
+			{
+				Found = true;
+				return Ptr;
+			}
+			if (Ptr > Start && Ptr[-1] == '*')
+			{
+				Found = true;
+				return Ptr - 1;
+			}
+			Mask &= Mask - 1;
+		}
+		Found = false;
+		return nullptr;
+	}
+
+#ifdef LEXER_HAS_X86_SCAN
+	__attribute__((target("sse2"))) inline __m128i whitespaceMask128(__m128i Chars)
+	{
+		// ' ' or '\t' .. '\r'
+		__m128i Offset = _mm_sub_epi8(Chars, _mm_set1_epi8('\t'));
+		__m128i InRange = _mm_cmpeq_epi8(_mm_min_epu8(Offset, _mm_set1_epi8('\r' - '\t')), Offset);
+		return _mm_or_si128(InRange, _mm_cmpeq_epi8(Chars, _mm_set1_epi8(' ')));
+	}
+
+	__attribute__((target("sse2"))) const char *skipWhitespaceSSE2(const char *Ptr)
+	{
+		const char *Block = (const char *)((uintptr_t)Ptr & ~(uintptr_t)15);
+		uint32_t Skip = Ptr - Block;
+		for (;;)
+		{
+			__m128i Chars = _mm_load_si128((const __m128i *)Block);
+			uint32_t Mask = ~_mm_movemask_epi8(whitespaceMask128(Chars)) & 0xFFFF;
+			Mask &= 0xFFFFu << Skip;
+			if (Mask)
+				return Block + llvm::countTrailingZeros(Mask);
+			Block += 16;
+			Skip = 0;
+		}
+	}
+
+	__attribute__((target("sse2"))) const char *findCommentEndSSE2(const char *Start)
+	{
+		const char *Block = (const char *)((uintptr_t)Start & ~(uintptr_t)15);
+		uint32_t Skip = Start - Block;
+		for (;;)
+		{
+			__m128i Chars = _mm_load_si128((const __m128i *)Block);
+			__m128i Candidates = _mm_or_si128(_mm_cmpeq_epi8(Chars, _mm_set1_epi8('/')),
+											  _mm_cmpeq_epi8(Chars, _mm_setzero_si128()));
+			uint32_t Mask = (uint32_t)_mm_movemask_epi8(Candidates) & (0xFFFFu << Skip);
+			bool Found;
+			const char *End = checkCommentCandidates(Block, Mask, Start, Found);
+			if (Found)
+				return End;
+			Block += 16;
+			Skip = 0;
 		}
-		if(*BufferPtr == '*' && *(BufferPtr + 1) == '/'){
-			BufferPtr += 2;
-			is_comment = false;
+	}
+
+	__attribute__((target("avx2"))) const char *skipWhitespaceAVX2(const char *Ptr)
+	{
+		const char *Block = (const char *)((uintptr_t)Ptr & ~(uintptr_t)31);
+		uint32_t Skip = Ptr - Block;
+		for (;;)
+		{
+			__m256i Chars = _mm256_load_si256((const __m256i *)Block);
+			__m256i Offset = _mm256_sub_epi8(Chars, _mm256_set1_epi8('\t'));
+			__m256i InRange = _mm256_cmpeq_epi8(_mm256_min_epu8(Offset, _mm256_set1_epi8('\r' - '\t')), Offset);
+			__m256i Space = _mm256_or_si256(InRange, _mm256_cmpeq_epi8(Chars, _mm256_set1_epi8(' ')));
+			uint32_t Mask = ~(uint32_t)_mm256_movemask_epi8(Space);
+			Mask &= 0xFFFFFFFFu << Skip;
+			if (Mask)
+				return Block + llvm::countTrailingZeros(Mask);
+			Block += 32;
+			Skip = 0;
 		}
-		else{
-			++BufferPtr;
+	}
+
+	__attribute__((target("avx2"))) const char *findCommentEndAVX2(const char *Start)
+	{
+		const char *Block = (const char *)((uintptr_t)Start & ~(uintptr_t)31);
+		uint32_t Skip = Start - Block;
+		for (;;)
+		{
+			__m256i Chars = _mm256_load_si256((const __m256i *)Block);
+			__m256i Candidates = _mm256_or_si256(_mm256_cmpeq_epi8(Chars, _mm256_set1_epi8('/')),
+												 _mm256_cmpeq_epi8(Chars, _mm256_setzero_si256()));
+			uint32_t Mask = (uint32_t)_mm256_movemask_epi8(Candidates) & (0xFFFFFFFFu << Skip);
+			bool Found;
+			const char *End = checkCommentCandidates(Block, Mask, Start, Found);
+			if (Found)
+				return End;
+			Block += 32;
+			Skip = 0;
 		}
-		while (*BufferPtr && charinfo::isWhitespace(*BufferPtr))
+	}
+#endif
+
+	using ScanFn = const char *(*)(const char *);
+
+	struct Scanners
+	{
+		ScanFn SkipWhitespace = skipWhitespaceScalar;
+		ScanFn FindCommentEnd = findCommentEndScalar;
+
+		// picks the widest implementation the running CPU supports
+		Scanners()
+		{
+#ifdef LEXER_HAS_X86_SCAN
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+			{
+				SkipWhitespace = skipWhitespaceAVX2;
+				FindCommentEnd = findCommentEndAVX2;
+			}
+			else if (__builtin_cpu_supports("sse2"))
+			{
+				SkipWhitespace = skipWhitespaceSSE2;
+				FindCommentEnd = findCommentEndSSE2;
+			}
+#endif
+		}
+	};
+
+	const Scanners &get()
+	{
+		static const Scanners Selected;
+		return Selected;
+	}
+}
+
+// Keywords are told apart by their length and first character, so an
+// identifier costs at most one string comparison however many keywords exist.
+static Token::TokenKind getKeywordKind(llvm::StringRef Context)
+{
+	auto match = [&Context](llvm::StringRef Keyword, Token::TokenKind Kind) {
+		return Context == Keyword ? Kind : Token::identifier;
+	};
+	switch (Context.size())
+	{
+	case 2:
+		switch (Context[0])
+		{
+		case 'i':
+			return match("if", Token::KW_if);
+		case 'o':
+			return match("or", Token::KW_or);
+		}
+		break;
+	case 3:
+		switch (Context[0])
+		{
+		case 'i':
+			return match("int", Token::KW_int);
+		case 'f':
+			return match("for", Token::KW_for);
+		case 'a':
+			return match("and", Token::KW_and);
+		}
+		break;
+	case 4:
+		switch (Context[0])
+		{
+		case 'b':
+			return match("bool", Token::KW_bool);
+		case 'e':
+			return match("else", Token::KW_else);
+		case 't':
+			return match("true", Token::KW_true);
+		}
+		break;
+	case 5:
+		switch (Context[0])
+		{
+		case 'w':
+			return match("while", Token::KW_while);
+		case 'f':
+			return match("false", Token::KW_false);
+		case 'p':
+			return match("print", Token::KW_print);
+		}
+		break;
+	}
+	return Token::identifier;
+}
+
+void Lexer::next(Token &token)
+{
+	const scan::Scanners &Scan = scan::get();
+
+	// Skips whitespace like " " and any comments between tokens
+	BufferPtr = Scan.SkipWhitespace(BufferPtr);
+	while (*BufferPtr == '/' && *(BufferPtr + 1) == '*')
+	{
+		const char *CommentEnd = Scan.FindCommentEnd(BufferPtr + 2);
+		if (!*CommentEnd)
 		{
-			++BufferPtr;
+			// unterminated comment runs to the end of the input
+			BufferPtr = CommentEnd;
+			token.Kind = Token::eof;
+			return;
 		}
+		BufferPtr = Scan.SkipWhitespace(CommentEnd + 2);
 	}
 	// since end of context is 0 -> !0 = true -> end of context
 	if (!*BufferPtr)
@@ -88,57 +300,13 @@ void Lexer::next(Token &token)
 		}
 
 		llvm::StringRef Context(BufferPtr, end - BufferPtr); // start of lexeme, length of lexeme
-		Token::TokenKind kind;
-		if (Context == "int")
-		{
-			kind = Token::KW_int;
-		}
-		else if (Context == "if")
-		{
-			kind = Token::KW_if;
-		}
-		else if (Context == "bool")
-		{
-			kind = Token::KW_bool;
-		}
-		else if (Context == "else")
-		{
-			kind = Token::KW_else;
-		}
-		else if (Context == "while")
-		{
-			kind = Token::KW_while;
-		}
-		else if (Context == "for")
-		{
-			kind = Token::KW_for;
-		}
-		else if (Context == "and")
-		{
-			kind = Token::KW_and;
-		}
-		else if (Context == "or")
-		{
-			kind = Token::KW_or;
-		}
-		else if (Context == "true")
-		{
-			kind = Token::KW_true;
-		}
-		else if (Context == "false")
-		{
-			kind = Token::KW_false;
-		}
-		else if (Context == "print")
-		{
-			kind = Token::KW_print;
-		}
-		else
-		{
-			kind = Token::identifier;
-		}
+		Token::TokenKind kind = getKeywordKind(Context);
 
 		formToken(token, end, kind);
+		if (kind == Token::identifier)
+		{
+			token.Symbol = Symbols.intern(Context);
+		}
 		return;
 	}
 
@@ -2,6 +2,7 @@
 #define LEXER_H
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "symbol_table.h"
 #include <string>
 
 
@@ -63,11 +64,13 @@ public:
 private:
     TokenKind Kind;       // <type of token>
     llvm::StringRef Text; // <token context>
+    unsigned Symbol;      // <interned name of identifiers>
 
 public:
     TokenKind getKind() const { return Kind; }
     bool is(TokenKind K) const { return Kind == K; }
     llvm::StringRef getText() const { return Text; }
+    unsigned getSymbol() const { return Symbol; }
 
     // kind="+" isOneOf(plus, minus) -> true
     bool isOneOf(TokenKind K1, TokenKind K2) const
@@ -86,9 +89,10 @@ class Lexer
 {
     const char *BufferStart;
     const char *BufferPtr;
+    SymbolTable &Symbols;
 
 public:
-    Lexer(const llvm::StringRef &Buffer)
+    Lexer(const llvm::StringRef &Buffer, SymbolTable &Symbols) : Symbols(Symbols)
     {
         BufferStart = Buffer.begin();
         BufferPtr = BufferStart;
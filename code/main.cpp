@@ -1,7 +1,10 @@
 
 #include "lexer.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/raw_ostream.h"
 #include <iostream>
 #include "AST.h"
@@ -9,6 +12,10 @@
 #include "code_generator.h"
 #include "parser.h"
 #include "semantic.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "interpreter.h"
+#include <chrono>
 
 using namespace std;
 
@@ -18,56 +25,237 @@ static llvm::cl::opt<std::string> Input(llvm::cl::Positional,
 										llvm::cl::init(""));
 
 static llvm::cl::opt<std::string> FileName("f",
-										   llvm::cl::desc("<Specify the file name>"),
+										   llvm::cl::desc("<Specify the file name, '-' for stdin>"),
 										   llvm::cl::value_desc("filename"),
 										   llvm::cl::init(""));
 
+static llvm::cl::opt<bool> ASTStats("ast-stats",
+									llvm::cl::desc("Print AST memory usage per node"),
+									llvm::cl::init(false));
+
+static llvm::cl::opt<bool> LexOnly("lex-only",
+									 llvm::cl::desc("Only run the lexer and report its throughput"),
+									 llvm::cl::init(false));
+
+static llvm::cl::opt<bool> OptStats("opt-stats",
+									llvm::cl::desc("Print what the AST optimizer changed"),
+									llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Run("run",
+								llvm::cl::desc("JIT-compile the program and execute it instead of printing IR"),
+								llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> OptLevel("O",
+										 llvm::cl::desc("LLVM optimization level (-O0, -O1, -O2, -O3)"),
+										 llvm::cl::Prefix, llvm::cl::ZeroOrMore,
+										 llvm::cl::init(0));
+
+enum OutputFileType
+{
+	IR,
+	Object,
+	Executable
+};
+
+static llvm::cl::opt<OutputFileType> FileType("filetype",
+											  llvm::cl::desc("Kind of output to produce"),
+											  llvm::cl::values(clEnumValN(IR, "ll", "Textual LLVM IR (default)"),
+															   clEnumValN(Object, "obj", "Native object file"),
+															   clEnumValN(Executable, "exe", "Executable linked with the runtime object")),
+											  llvm::cl::init(IR));
+
+static llvm::cl::opt<std::string> OutputFile("o",
+											 llvm::cl::desc("Output file name"),
+											 llvm::cl::value_desc("filename"),
+											 llvm::cl::init(""));
+
+static llvm::cl::opt<std::string> RuntimeObject("runtime",
+												llvm::cl::desc("Prebuilt object of project_lib.c to link executables with"),
+												llvm::cl::value_desc("filename"),
+												llvm::cl::init(""));
+
+static llvm::cl::opt<bool> NoASTOpt("no-ast-opt",
+									llvm::cl::desc("Skip the AST optimizer (constant propagation, closed-form loops, hoisting, unrolling and dead code removal)"),
+									llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> UnrollCount("unroll-factor",
+										   llvm::cl::desc("Unroll every counted loop this many times instead of using the cost model (1 disables unrolling)"),
+										   llvm::cl::init(0));
+
+static llvm::cl::opt<bool> UnrollReport("unroll-report",
+										llvm::cl::desc("Print the unroll factor chosen for each loop"),
+										llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Eval("eval",
+								 llvm::cl::desc("Run the program at compile time and emit only its output"),
+								 llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned long long> EvalBudget("eval-budget",
+													llvm::cl::desc("Steps -eval may take before falling back to normal compilation"),
+													llvm::cl::init(10000000));
+
+// links Object with the runtime into Output using the system C compiler driver
+static int linkExecutable(llvm::StringRef Object, llvm::StringRef Output)
+{
+	llvm::ErrorOr<std::string> Driver = llvm::sys::findProgramByName("cc");
+	if (!Driver)
+	{
+		llvm::errs() << "Error: no 'cc' found in PATH to link the executable\n";
+		return 1;
+	}
+	llvm::StringRef Args[] = {*Driver, Object, RuntimeObject, "-o", Output};
+	std::string ErrMsg;
+	int Result = llvm::sys::ExecuteAndWait(*Driver, Args, llvm::None, {}, 0, 0, &ErrMsg);
+	if (Result != 0)
+	{
+		llvm::errs() << "Error linking " << Output << ": " << (ErrMsg.empty() ? "linker failed" : ErrMsg) << "\n";
+		return 1;
+	}
+	return 0;
+}
+
 int main(int argc, const char **argv)
 {
 	// parse command line with builtin llvm function
 	llvm::InitLLVM X(argc, argv);
 	llvm::cl::ParseCommandLineOptions(argc, argv, "MAS-Lang Compiler\n");
+	if (OptLevel > 3)
+	{
+		llvm::errs() << "Invalid optimization level -O" << OptLevel << "\n";
+		return 1;
+	}
+	if (FileType == Executable && RuntimeObject.empty())
+	{
+		llvm::errs() << "-filetype=exe needs the runtime object, pass it with -runtime\n";
+		return 1;
+	}
 
-	string contentString;
+	// the lexer reads straight from the buffer (mmapped for large files),
+	// so it has to stay alive until code generation is done
+	std::unique_ptr<llvm::MemoryBuffer> contentBuffer;
 	llvm::StringRef contentRef;
 
-	if (!FileName.empty()) // if filename is specified
+	if (!FileName.empty() || Input.getNumOccurrences() == 0) // if filename is specified or nothing is given
 	{
-		std::string fileName = FileName;
+		std::string fileName = FileName.empty() ? std::string("-") : FileName.getValue();
 
-		// Use llvm::MemoryBuffer::getFile with the fileName
+		// "-" reads the program from stdin
 		llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileOrErr =
-			llvm::MemoryBuffer::getFile(fileName);
+			llvm::MemoryBuffer::getFileOrSTDIN(fileName);
 
 		if (auto error = fileOrErr.getError())
 		{
 			llvm::errs() << "Error opening file: " << error.message() << "\n";
 			return 1;
 		}
-		// Use the file content from the MemoryBuffer
-		contentString = (*fileOrErr)->getBuffer().str();
+		contentBuffer = std::move(*fileOrErr);
+		contentRef = contentBuffer->getBuffer();
 	}
 	else // if input is given directly
 	{
-		contentString = Input;
+		contentRef = Input;
 	}
 
-	contentRef = contentString;
 	Token nextToken;
-	Lexer lexer(contentRef);
-	Parser Parser(lexer);
+	ASTContext Context;
+	Lexer lexer(contentRef, Context.getSymbols());
+
+	if (LexOnly)
+	{
+		auto start = std::chrono::steady_clock::now();
+		unsigned long tokens = 0;
+		do
+		{
+			lexer.next(nextToken);
+			++tokens;
+		} while (!nextToken.is(Token::eof));
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		llvm::errs() << tokens << " tokens, " << contentRef.size() << " bytes in "
+					 << llvm::format("%.1f", elapsed.count() * 1000) << " ms ("
+					 << (unsigned long)(tokens / elapsed.count()) << " tokens/s)\n";
+		return 0;
+	}
+	Parser Parser(lexer, Context);
 	AST *Tree = Parser.parse();
+	if (ASTStats)
+		Context.printStats(llvm::errs());
 
 	Semantic semantic;
-	if (semantic.semantic(Tree))
+	if (semantic.semantic(Tree, Context.getSymbols()))
 	{
 		llvm::errs() << "Semantic errors occurred...\n";
 		return 1;
 	}
 
+	// programs read no input, so within budget the output is known now
+	bool Evaluated = false;
+	if (Eval)
+	{
+		uint64_t Steps;
+		Evaluated = evaluateProgram(Context, Tree, EvalBudget, Steps);
+		if (OptStats)
+			llvm::errs() << "compile-time evaluation: " << (Evaluated ? "done" : "gave up") << " after " << Steps << " steps\n";
+	}
+
+	if (!Evaluated && !NoASTOpt)
+	{
+		OptimizerOptions Options;
+		Options.Hoist = true;
+		Options.RemoveDeadCode = true;
+		Options.Unroll = true;
+		Options.UnrollFactor = UnrollCount;
+		if (UnrollReport)
+			Options.UnrollReport = &llvm::errs();
+		OptimizerStats Stats;
+		optimizeAST(Context, Tree, Options, Stats);
+		if (OptStats)
+			Stats.print(llvm::errs());
+	}
+
 	CodeGen CodeGenerator;
-	bool optimize = true;
-	int k = 2;
-	CodeGenerator.compile(Tree, optimize, k);
+	std::unique_ptr<llvm::LLVMContext> Ctx = std::make_unique<llvm::LLVMContext>();
+	std::unique_ptr<llvm::Module> Module = CodeGenerator.compile(Tree, Context, *Ctx);
+
+	CodeGenerator.optimizeModule(*Module, OptLevel);
+
+	if (Run)
+	{
+		return runModule(std::move(Module), std::move(Ctx), OptLevel);
+	}
+
+	if (FileType == Object)
+	{
+		std::string Output = OutputFile.empty() ? std::string("output.o") : OutputFile.getValue();
+		return CodeGenerator.emitObject(*Module, Output, OptLevel) ? 1 : 0;
+	}
+
+	if (FileType == Executable)
+	{
+		std::string Output = OutputFile.empty() ? std::string("a.out") : OutputFile.getValue();
+		llvm::SmallString<128> TempObject;
+		if (auto EC = llvm::sys::fs::createTemporaryFile("mas", "o", TempObject))
+		{
+			llvm::errs() << "Error creating temporary file: " << EC.message() << "\n";
+			return 1;
+		}
+		int Result = CodeGenerator.emitObject(*Module, TempObject, OptLevel) ? 1 : linkExecutable(TempObject, Output);
+		llvm::sys::fs::remove(TempObject);
+		return Result;
+	}
+
+	// Print the generated module to the standard output, or to -o
+	if (!OutputFile.empty())
+	{
+		std::error_code EC;
+		llvm::raw_fd_ostream Out(OutputFile, EC, llvm::sys::fs::OF_Text);
+		if (EC)
+		{
+			llvm::errs() << "Error opening " << OutputFile << ": " << EC.message() << "\n";
+			return 1;
+		}
+		Module->print(Out, nullptr);
+		return 0;
+	}
+	Module->print(llvm::outs(), nullptr);
 	return 0;
 }
@@ -1,142 +1,2204 @@
 #include "optimizer.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Twine.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
-Expression *updateExpression(Expression *expression, llvm::StringRef iterator, int increase)
+Expression *updateExpression(ASTContext &Context, Expression *expression, unsigned iterator, int increase, UpdateCache &cache)
 {
-    if (expression->isVariable() && expression->getValue() == iterator)
+    if (increase == 0 || !(expression->isVariable() || expression->isBinaryOp() || expression->isBooleanOp()))
+        return expression;
+    if (expression->isVariable() && expression->getSymbol() != iterator)
+        return expression;
+
+    // every read of the iterator shares one iterator + increase node
+    Expression *key = expression->isVariable() ? nullptr : expression;
+    auto cached = cache.Updated.find({key, increase});
+    if (cached != cache.Updated.end())
     {
-        return new BinaryOp(BinaryOp::Plus, new Expression(iterator), new Expression(increase));
+        ++cache.Shared;
+        return cached->second;
     }
-    if (expression->isBinaryOp())
+
+    Expression *result = expression;
+    if (expression->isVariable())
     {
-        BinaryOp *binaryOp = (BinaryOp *)expression;
-        Expression *left = updateExpression(binaryOp->getLeft(), iterator, increase);
-        Expression *right = updateExpression(binaryOp->getRight(), iterator, increase);
-        return new BinaryOp(binaryOp->getOperator(), left, right);
+        result = Context.create<BinaryOp>(BinaryOp::Plus, expression, Context.create<Expression>(increase));
+        cache.Created += 2;
     }
-    if (expression->isBooleanOp())
+    else
     {
-        BooleanOp *booleanOp = (BooleanOp *)expression;
-        Expression *left = updateExpression(booleanOp->getLeft(), iterator, increase);
-        Expression *right = updateExpression(booleanOp->getRight(), iterator, increase);
-        return new BooleanOp(booleanOp->getOperator(), left, right);
+        // subtrees without the iterator come back unchanged and are shared
+        bool isBinary = expression->isBinaryOp();
+        Expression *oldLeft = isBinary ? ((BinaryOp *)expression)->getLeft() : ((BooleanOp *)expression)->getLeft();
+        Expression *oldRight = isBinary ? ((BinaryOp *)expression)->getRight() : ((BooleanOp *)expression)->getRight();
+        Expression *left = updateExpression(Context, oldLeft, iterator, increase, cache);
+        Expression *right = updateExpression(Context, oldRight, iterator, increase, cache);
+        if (left == oldLeft && right == oldRight)
+            ++cache.Shared;
+        else
+        {
+            if (isBinary)
+                result = Context.create<BinaryOp>(((BinaryOp *)expression)->getOperator(), left, right);
+            else
+                result = Context.create<BooleanOp>(((BooleanOp *)expression)->getOperator(), left, right);
+            ++cache.Created;
+        }
     }
-    return expression;
+    cache.Updated[{key, increase}] = result;
+    return result;
 }
 
-Statement *updateStatement(Statement *statement, llvm::StringRef iterator, int increase)
+llvm::SmallVector<Statement *> updateStatements(ASTContext &Context, llvm::ArrayRef<Statement *> statements, unsigned iterator, int increase, UpdateCache &cache)
 {
-    AssignStatement *assignment = (AssignStatement *)statement;
-    Expression *right = assignment->getRValue();
-    Expression *newRight = updateExpression(right, iterator, increase);
-    return new AssignStatement(assignment->getLValue(), newRight);
+    llvm::SmallVector<Statement *> result;
+    result.reserve(statements.size());
+    for (Statement *statement : statements)
+        result.push_back(updateStatement(Context, statement, iterator, increase, cache));
+    return result;
 }
 
-llvm::SmallVector<Statement *> completeUnroll(ForStatement *forStatement, int k){
-    llvm::SmallVector<Statement *> unrolledStatements;
-    llvm::SmallVector<Statement *> body = forStatement->getStatements();
+Statement *updateStatement(ASTContext &Context, Statement *statement, unsigned iterator, int increase, UpdateCache &cache)
+{
+    switch (statement->getKind())
+    {
+    case Statement::StatementType::Declaration:
+    {
+        DecStatement *declaration = (DecStatement *)statement;
+        Expression *right = declaration->getRValue() ? updateExpression(Context, declaration->getRValue(), iterator, increase, cache) : nullptr;
+        return Context.create<DecStatement>(declaration->getLValue(), right, declaration->getDecType());
+    }
+    case Statement::StatementType::Assignment:
+    {
+        AssignStatement *assignment = (AssignStatement *)statement;
+        return Context.create<AssignStatement>(assignment->getLValue(), updateExpression(Context, assignment->getRValue(), iterator, increase, cache));
+    }
+    case Statement::StatementType::Print:
+        return Context.create<PrintStatement>(updateExpression(Context, ((PrintStatement *)statement)->getExpr(), iterator, increase, cache));
+    case Statement::StatementType::If:
+    {
+        IfStatement *ifStatement = (IfStatement *)statement;
+        llvm::SmallVector<ElseIfStatement *> elseIfs;
+        for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+            elseIfs.push_back((ElseIfStatement *)updateStatement(Context, elseIf, iterator, increase, cache));
+        ElseStatement *elseStatement = ifStatement->HasElse() ? (ElseStatement *)updateStatement(Context, ifStatement->getElseStatement(), iterator, increase, cache) : nullptr;
+        return Context.create<IfStatement>(updateExpression(Context, ifStatement->getCondition(), iterator, increase, cache),
+                                           updateStatements(Context, ifStatement->getStatements(), iterator, increase, cache),
+                                           std::move(elseIfs), elseStatement, ifStatement->HasElseIf(), ifStatement->HasElse(),
+                                           Statement::StatementType::If);
+    }
+    case Statement::StatementType::ElseIf:
+    {
+        ElseIfStatement *elseIf = (ElseIfStatement *)statement;
+        return Context.create<ElseIfStatement>(updateExpression(Context, elseIf->getCondition(), iterator, increase, cache),
+                                               updateStatements(Context, elseIf->getStatements(), iterator, increase, cache),
+                                               Statement::StatementType::ElseIf);
+    }
+    case Statement::StatementType::Else:
+        return Context.create<ElseStatement>(updateStatements(Context, ((ElseStatement *)statement)->getStatements(), iterator, increase, cache),
+                                             Statement::StatementType::Else);
+    case Statement::StatementType::While:
+    {
+        WhileStatement *whileStatement = (WhileStatement *)statement;
+        return Context.create<WhileStatement>(updateExpression(Context, whileStatement->getCondition(), iterator, increase, cache),
+                                              updateStatements(Context, whileStatement->getStatements(), iterator, increase, cache),
+                                              Statement::StatementType::While, whileStatement->isOptimized());
+    }
+    case Statement::StatementType::For:
+    {
+        ForStatement *forStatement = (ForStatement *)statement;
+        return Context.create<ForStatement>(updateExpression(Context, forStatement->getCondition(), iterator, increase, cache),
+                                            updateStatements(Context, forStatement->getStatements(), iterator, increase, cache),
+                                            (AssignStatement *)updateStatement(Context, forStatement->getInitialAssign(), iterator, increase, cache),
+                                            (AssignStatement *)updateStatement(Context, forStatement->getUpdateAssign(), iterator, increase, cache),
+                                            Statement::StatementType::For, forStatement->isOptimized());
+    }
+    }
+    return statement;
+}
+
+namespace
+{
+    // a fully unrolled loop may grow the tree by at most this many nodes
+    const unsigned MaxCompleteUnrollNodes = 1 << 14;
+
+    bool assignsVariable(llvm::ArrayRef<Statement *> Stmts, unsigned Var);
+
+    bool assignsVariable(Statement *Stmt, unsigned Var)
+    {
+        switch (Stmt->getKind())
+        {
+        case Statement::StatementType::Declaration:
+            return ((DecStatement *)Stmt)->getLValue()->getSymbol() == Var;
+        case Statement::StatementType::Assignment:
+            return ((AssignStatement *)Stmt)->getLValue()->getSymbol() == Var;
+        case Statement::StatementType::If:
+        {
+            IfStatement *ifStatement = (IfStatement *)Stmt;
+            if (assignsVariable(ifStatement->getStatements(), Var))
+                return true;
+            for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                if (assignsVariable(elseIf->getStatements(), Var))
+                    return true;
+            return ifStatement->HasElse() && assignsVariable(ifStatement->getElseStatement()->getStatements(), Var);
+        }
+        case Statement::StatementType::While:
+            return assignsVariable(((WhileStatement *)Stmt)->getStatements(), Var);
+        case Statement::StatementType::For:
+        {
+            ForStatement *forStatement = (ForStatement *)Stmt;
+            return forStatement->getInitialAssign()->getLValue()->getSymbol() == Var ||
+                   forStatement->getUpdateAssign()->getLValue()->getSymbol() == Var ||
+                   assignsVariable(forStatement->getStatements(), Var);
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool assignsVariable(llvm::ArrayRef<Statement *> Stmts, unsigned Var)
+    {
+        for (Statement *Stmt : Stmts)
+            if (assignsVariable(Stmt, Var))
+                return true;
+        return false;
+    }
+
+    // finds the literal Var holds after Stmts, if the last write to it stores one
+    bool findEntryValue(llvm::ArrayRef<Statement *> Stmts, unsigned Var, int32_t &Value)
+    {
+        for (Statement *Stmt : llvm::reverse(Stmts))
+        {
+            if (!assignsVariable(Stmt, Var))
+                continue;
+            Expression *Literal = nullptr;
+            if (Stmt->getKind() == Statement::StatementType::Declaration)
+            {
+                // an uninitialized int is zero
+                Literal = ((DecStatement *)Stmt)->getRValue();
+                if (!Literal)
+                {
+                    Value = 0;
+                    return true;
+                }
+            }
+            else if (Stmt->getKind() == Statement::StatementType::Assignment)
+                Literal = ((AssignStatement *)Stmt)->getRValue();
+            if (!Literal || !Literal->isNumber())
+                return false;
+            Value = Literal->getNumber();
+            return true;
+        }
+        return false;
+    }
+
+    // A loop of the form
+    //   Iterator Op Bound, Iterator = Iterator + Step
+    // where nothing else in the body writes Iterator.
+    struct CountedLoop
+    {
+        Expression *Iterator = nullptr;
+        BooleanOp::Operator Op = BooleanOp::Less; // Less, LessEqual, Greater or GreaterEqual
+        Expression *Bound = nullptr;
+        int32_t Step = 0;
+        bool HasInit = false; // Iterator holds Init when the loop is entered
+        int32_t Init = 0;
+    };
+
+    BooleanOp::Operator swapComparison(BooleanOp::Operator Op)
+    {
+        switch (Op)
+        {
+        case BooleanOp::Less:
+            return BooleanOp::Greater;
+        case BooleanOp::LessEqual:
+            return BooleanOp::GreaterEqual;
+        case BooleanOp::Greater:
+            return BooleanOp::Less;
+        case BooleanOp::GreaterEqual:
+            return BooleanOp::LessEqual;
+        default:
+            return Op;
+        }
+    }
+
+    // true when Expr reads neither Iterator nor anything Stmts write
+    bool isLoopInvariant(Expression *Expr, unsigned Iterator, llvm::ArrayRef<Statement *> Stmts)
+    {
+        if (Expr->isVariable())
+            return Expr->getSymbol() != Iterator && !assignsVariable(Stmts, Expr->getSymbol());
+        if (Expr->isBinaryOp())
+            return isLoopInvariant(((BinaryOp *)Expr)->getLeft(), Iterator, Stmts) &&
+                   isLoopInvariant(((BinaryOp *)Expr)->getRight(), Iterator, Stmts);
+        return Expr->isNumber();
+    }
+
+    // recognizes Iterator Op Bound and Bound Op Iterator, Bound being invariant in Stmts
+    bool matchCondition(Expression *Condition, unsigned Iterator, llvm::ArrayRef<Statement *> Stmts, CountedLoop &Loop)
+    {
+        if (!Condition->isBooleanOp())
+            return false;
+        BooleanOp *Compare = (BooleanOp *)Condition;
+        BooleanOp::Operator Op = Compare->getOperator();
+        Expression *Left = Compare->getLeft(), *Right = Compare->getRight();
+        if (Right->isVariable() && Right->getSymbol() == Iterator)
+        {
+            std::swap(Left, Right);
+            Op = swapComparison(Op);
+        }
+        if (!Left->isVariable() || Left->getSymbol() != Iterator || !isLoopInvariant(Right, Iterator, Stmts))
+            return false;
+        if (Op != BooleanOp::Less && Op != BooleanOp::LessEqual && Op != BooleanOp::Greater &&
+            Op != BooleanOp::GreaterEqual && Op != BooleanOp::NotEqual)
+            return false;
+        Loop.Iterator = Left;
+        Loop.Op = Op;
+        Loop.Bound = Right;
+        return true;
+    }
+
+    // recognizes Iterator = Iterator + c, Iterator = c + Iterator and Iterator = Iterator - c
+    bool matchUpdate(AssignStatement *Update, unsigned Iterator, int32_t &Step)
+    {
+        if (Update->getLValue()->getSymbol() != Iterator || !Update->getRValue()->isBinaryOp())
+            return false;
+        BinaryOp *Value = (BinaryOp *)Update->getRValue();
+        Expression *Left = Value->getLeft(), *Right = Value->getRight();
+        bool IsMinus = Value->getOperator() == BinaryOp::Minus;
+        if (Value->getOperator() == BinaryOp::Plus && Left->isNumber())
+            std::swap(Left, Right);
+        else if (!IsMinus && Value->getOperator() != BinaryOp::Plus)
+            return false;
+        if (!Left->isVariable() || Left->getSymbol() != Iterator || !Right->isNumber() || Right->getNumber() == 0)
+            return false;
+        if (IsMinus && Right->getNumber() == INT32_MIN)
+            return false;
+        Step = IsMinus ? -Right->getNumber() : Right->getNumber();
+        return true;
+    }
+
+    // Checks that the loop runs towards its bound, turning != into < or >.
+    // Sets Trips when the number of iterations is known.
+    bool checkDirection(CountedLoop &Loop, int64_t &Trips)
+    {
+        Trips = -1;
+        bool KnownBound = Loop.Bound->isNumber();
+        int64_t Bound = KnownBound ? Loop.Bound->getNumber() : 0, Step = Loop.Step;
+        if (Loop.Op == BooleanOp::NotEqual)
+        {
+            // only when the iterator hits the bound exactly
+            if (!Loop.HasInit || !KnownBound)
+                return false;
+            int64_t Distance = Bound - Loop.Init;
+            if (Distance % Step != 0 || (Distance != 0 && (Distance < 0) != (Step < 0)))
+                return false;
+            Loop.Op = Step > 0 ? BooleanOp::Less : BooleanOp::Greater;
+        }
+        bool Up = Loop.Op == BooleanOp::Less || Loop.Op == BooleanOp::LessEqual;
+        if (Up != (Step > 0))
+            return false;
+        if (!Loop.HasInit || !KnownBound)
+            return true;
+
+        // count in the direction of the step so both cases look like <
+        int64_t Init = Loop.Init, Abs = Step > 0 ? Step : -Step;
+        int64_t Distance = Up ? Bound - Init : Init - Bound;
+        if (Loop.Op == BooleanOp::LessEqual || Loop.Op == BooleanOp::GreaterEqual)
+            ++Distance;
+        Trips = Distance <= 0 ? 0 : (Distance + Abs - 1) / Abs;
+        // the iterator would wrap before the condition fails
+        int64_t Final = Init + Trips * Step;
+        return Final >= INT32_MIN && Final <= INT32_MAX;
+    }
 
-    // Get for variables and constants
-    int initialIterator = forStatement->getInitialAssign()->getRValue()->getNumber();
-    BooleanOp *condition_boolean_op = (BooleanOp *)forStatement->getCondition();
-    int conditionValue = condition_boolean_op->getRight()->getNumber();
-    int conditionValue_arash = conditionValue;
-    if(condition_boolean_op->getOperator() == BooleanOp::LessEqual){
-        conditionValue++;
+    // Limits of the unroll cost model
+    const unsigned MaxUnrollFactor = 8;
+    const unsigned UnrolledBodyBudget = 256; // AST nodes of unrolled body, a stand-in for instruction cache footprint
+    const unsigned RegisterBudget = 12;      // general purpose registers left for values live in the loop
+
+    // registers needed to evaluate Expr without spilling (Sethi-Ullman number)
+    unsigned registersNeeded(Expression *Expr)
+    {
+        Expression *Left, *Right;
+        if (Expr->isBinaryOp())
+            Left = ((BinaryOp *)Expr)->getLeft(), Right = ((BinaryOp *)Expr)->getRight();
+        else if (Expr->isBooleanOp())
+            Left = ((BooleanOp *)Expr)->getLeft(), Right = ((BooleanOp *)Expr)->getRight();
+        else
+            return 1;
+        unsigned L = registersNeeded(Left), R = registersNeeded(Right);
+        return L == R ? L + 1 : std::max(L, R);
     }
-    int updateValue = ((BinaryOp *)forStatement->getUpdateAssign()->getRValue())->getRight()->getNumber();
-    if(k>0){
-        llvm::SmallVector<Statement *> newForBody;
-        for(Statement *statement : body){
-            
-            for(int i = 0; i < k; i++){
-                AssignStatement* assignStatement = (AssignStatement *)statement;
-                Statement *newStatement = updateStatement(statement, forStatement->getInitialAssign()->getLValue()->getValue(), i * updateValue);
-                newForBody.push_back(newStatement);
+
+    void collectVariables(Expression *Expr, llvm::DenseSet<unsigned> &Vars)
+    {
+        if (Expr->isVariable())
+            Vars.insert(Expr->getSymbol());
+        else if (Expr->isBinaryOp())
+            collectVariables(((BinaryOp *)Expr)->getLeft(), Vars), collectVariables(((BinaryOp *)Expr)->getRight(), Vars);
+        else if (Expr->isBooleanOp())
+            collectVariables(((BooleanOp *)Expr)->getLeft(), Vars), collectVariables(((BooleanOp *)Expr)->getRight(), Vars);
+    }
+
+    // Pressure estimate of one iteration: every variable the body touches,
+    // nested loops included, stays live across it, plus the widest
+    // expression. Sets HasLoop when the body contains a nested loop.
+    unsigned estimatePressure(llvm::ArrayRef<Statement *> Body, bool &HasLoop)
+    {
+        llvm::DenseSet<unsigned> Vars;
+        unsigned Widest = 0;
+        auto visitExpression = [&](Expression *Expr)
+        {
+            collectVariables(Expr, Vars);
+            Widest = std::max(Widest, registersNeeded(Expr));
+        };
+        llvm::SmallVector<Statement *> Worklist(Body.begin(), Body.end());
+        while (!Worklist.empty())
+        {
+            Statement *Stmt = Worklist.pop_back_val();
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::Declaration:
+            {
+                DecStatement *declaration = (DecStatement *)Stmt;
+                Vars.insert(declaration->getLValue()->getSymbol());
+                if (declaration->getRValue())
+                    visitExpression(declaration->getRValue());
+                break;
+            }
+            case Statement::StatementType::Assignment:
+                Vars.insert(((AssignStatement *)Stmt)->getLValue()->getSymbol());
+                visitExpression(((AssignStatement *)Stmt)->getRValue());
+                break;
+            case Statement::StatementType::Print:
+                visitExpression(((PrintStatement *)Stmt)->getExpr());
+                break;
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                visitExpression(ifStatement->getCondition());
+                Worklist.append(ifStatement->getStatements().begin(), ifStatement->getStatements().end());
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    Worklist.push_back(elseIf);
+                if (ifStatement->HasElse())
+                    Worklist.push_back(ifStatement->getElseStatement());
+                break;
+            }
+            case Statement::StatementType::ElseIf:
+                visitExpression(((ElseIfStatement *)Stmt)->getCondition());
+                Worklist.append(((ElseIfStatement *)Stmt)->getStatements().begin(), ((ElseIfStatement *)Stmt)->getStatements().end());
+                break;
+            case Statement::StatementType::Else:
+                Worklist.append(((ElseStatement *)Stmt)->getStatements().begin(), ((ElseStatement *)Stmt)->getStatements().end());
+                break;
+            // what a nested loop touches is live in the body as well
+            case Statement::StatementType::While:
+            {
+                WhileStatement *whileStatement = (WhileStatement *)Stmt;
+                HasLoop = true;
+                visitExpression(whileStatement->getCondition());
+                Worklist.append(whileStatement->getStatements().begin(), whileStatement->getStatements().end());
+                break;
+            }
+            case Statement::StatementType::For:
+            {
+                ForStatement *forStatement = (ForStatement *)Stmt;
+                HasLoop = true;
+                Worklist.push_back(forStatement->getInitialAssign());
+                Worklist.push_back(forStatement->getUpdateAssign());
+                visitExpression(forStatement->getCondition());
+                Worklist.append(forStatement->getStatements().begin(), forStatement->getStatements().end());
+                break;
+            }
             }
         }
-        AssignStatement * newForUpdate = new AssignStatement(forStatement->getUpdateAssign()->getLValue(), new BinaryOp(BinaryOp::Plus, forStatement->getUpdateAssign()->getLValue(), new Expression(k * updateValue)));
-        Expression* newCondition = new BooleanOp(condition_boolean_op->getOperator(), forStatement->getInitialAssign()->getLValue(), new Expression(conditionValue_arash - updateValue));
-        ForStatement* newForStatement = new ForStatement(newCondition, newForBody, forStatement->getInitialAssign(), newForUpdate, Statement::StatementType::For, true);
-        unrolledStatements.push_back(newForStatement);
-        if(conditionValue % (k * updateValue) != 0){
-             body.push_back(forStatement->getUpdateAssign());
-             WhileStatement* afterForStatement = new WhileStatement(forStatement->getCondition(), body, Statement::StatementType::While, true);  
-             unrolledStatements.push_back(afterForStatement);
-         }
-        return unrolledStatements;
+        return Vars.size() + Widest;
     }
-    for (int i = initialIterator; i < conditionValue; i += updateValue){
-        for (Statement *statement : body)
+
+    // Picks the unroll factor of a counted loop. Known short loops are
+    // unrolled completely; others get the largest power of two whose copies
+    // fit the node budget and the register budget, one register more per
+    // copy for its iterator offset, preferring a factor that divides the
+    // trip count so no epilogue is needed.
+    unsigned chooseUnrollFactor(llvm::ArrayRef<Statement *> Body, int64_t Trips, unsigned &Pressure, const char *&Reason)
+    {
+        unsigned Nodes = countNodes(Body) + 1;
+        bool HasLoop = false;
+        Pressure = estimatePressure(Body, HasLoop);
+        if (Trips >= 0 && (uint64_t)Trips * Nodes <= UnrolledBodyBudget)
+        {
+            Reason = "complete";
+            return Trips;
+        }
+        if (HasLoop)
         {
-            Statement *newStatement = updateStatement(statement, forStatement->getInitialAssign()->getLValue()->getValue(), i);
-            unrolledStatements.push_back(newStatement);
+            Reason = "contains a loop";
+            return 1;
         }
+
+        unsigned Factor = 1;
+        Reason = "body too large";
+        for (unsigned K = 2; K <= MaxUnrollFactor; K *= 2)
+        {
+            if (K * Nodes > UnrolledBodyBudget)
+                break;
+            if (Pressure + K - 1 > RegisterBudget)
+            {
+                Reason = Factor == 1 ? "register pressure" : "";
+                break;
+            }
+            Factor = K;
+            Reason = "";
+        }
+        if (Trips > 0)
+            for (unsigned K = Factor; K >= 2; K /= 2)
+                if (Trips % K == 0)
+                {
+                    Factor = K;
+                    break;
+                }
+        return Factor;
     }
 
-    return unrolledStatements;
+    // Unrolls a counted loop. Init is the initial assignment of a for loop.
+    // Body holds the statements without the update; those at UpdateIndex and
+    // after run once the iterator has already been advanced. Epilogue is the
+    // original body, run for the iterations left over by the unrolled loop.
+    // The factor is Options.UnrollFactor, or the cost model's choice when 0.
+    bool unrollCountedLoop(ASTContext &Context, CountedLoop &Loop, AssignStatement *Init, llvm::ArrayRef<Statement *> Body,
+                           size_t UpdateIndex, llvm::SmallVector<Statement *> Epilogue, const OptimizerOptions &Options,
+                           llvm::SmallVectorImpl<Statement *> &Result, OptimizerStats &Stats)
+    {
+        int64_t Trips;
+        if (!checkDirection(Loop, Trips))
+            return false;
+
+        unsigned Pressure = 0;
+        const char *Reason = "forced";
+        int64_t k = Options.UnrollFactor > 0 ? Options.UnrollFactor : chooseUnrollFactor(Body, Trips, Pressure, Reason);
+        if (Options.UnrollReport)
+        {
+            llvm::raw_ostream &OS = *Options.UnrollReport;
+            OS << "unroll " << Loop.Iterator->getValue() << ": factor " << k << ", body " << countNodes(Body) << " nodes";
+            if (Trips >= 0)
+                OS << ", " << Trips << " trips";
+            if (Options.UnrollFactor <= 0)
+                OS << ", pressure " << Pressure;
+            if (*Reason)
+                OS << " (" << Reason << ")";
+            OS << "\n";
+        }
+
+        unsigned Var = Loop.Iterator->getSymbol();
+        UpdateCache Cache;
+        auto appendCopies = [&](llvm::SmallVectorImpl<Statement *> &Into, int64_t Copies)
+        {
+            for (int64_t J = 0; J < Copies; ++J)
+                for (size_t I = 0, E = Body.size(); I != E; ++I)
+                    Into.push_back(updateStatement(Context, Body[I], Var, (int)((J + (I >= UpdateIndex)) * Loop.Step), Cache));
+            Stats.UnrollNodesCreated += Cache.Created;
+            Stats.UnrollNodesShared += Cache.Shared;
+            Cache.Created = Cache.Shared = 0;
+        };
+
+        // the whole loop is known and small: replace it by straight-line code
+        if (Trips >= 0 && Trips <= k)
+        {
+            if ((uint64_t)Trips * (countNodes(Body) + 1) > MaxCompleteUnrollNodes)
+                return false;
+            if (Init)
+                Result.push_back(Init);
+            appendCopies(Result, Trips);
+            Expression *Final = Context.create<Expression>((int)(Loop.Init + Trips * Loop.Step));
+            Result.push_back(Context.create<AssignStatement>(Loop.Iterator, Final));
+            return true;
+        }
+        if (k < 2)
+            return false;
+
+        // Iterator Op Bound - (k - 1) * Step guarantees k more iterations
+        int64_t Offset = (int64_t)(k - 1) * Loop.Step, Stride = (int64_t)k * Loop.Step;
+        if (Stride < INT32_MIN || Stride > INT32_MAX)
+            return false;
+        Expression *Limit;
+        if (Loop.Bound->isNumber())
+        {
+            int64_t MainBound = Loop.Bound->getNumber() - Offset;
+            if (MainBound < INT32_MIN || MainBound > INT32_MAX)
+                return false;
+            Limit = Context.create<Expression>((int)MainBound);
+        }
+        else
+        {
+            // the limit is computed once when the loop is reached
+            SymbolTable &Symbols = Context.getSymbols();
+            unsigned Temp = Symbols.intern(("unroll.limit" + llvm::Twine(Symbols.size())).str());
+            Limit = Context.create<Expression>(Symbols.getName(Temp), Temp);
+            if (Init)
+                Result.push_back(Init);
+            Init = nullptr;
+            Result.push_back(Context.create<DecStatement>(Limit, Loop.Bound, DecStatement::DecStatementType::Number));
+        }
+
+        llvm::SmallVector<Statement *> MainBody;
+        appendCopies(MainBody, k);
+        Expression *MainCondition = Context.create<BooleanOp>(Loop.Op, Loop.Iterator, Limit);
+        AssignStatement *MainUpdate = Context.create<AssignStatement>(
+            Loop.Iterator, Context.create<BinaryOp>(BinaryOp::Plus, Loop.Iterator, Context.create<Expression>((int)Stride)));
+        Statement *Main;
+        if (Init)
+            Main = Context.create<ForStatement>(MainCondition, std::move(MainBody), Init, MainUpdate, Statement::StatementType::For, true);
+        else
+        {
+            MainBody.push_back(MainUpdate);
+            Main = Context.create<WhileStatement>(MainCondition, std::move(MainBody), Statement::StatementType::While, true);
+        }
+
+        if (Loop.Bound->isNumber())
+            Result.push_back(Main);
+        else
+        {
+            // when Bound - Offset would wrap fewer than k iterations are left and only the epilogue runs
+            bool Up = Loop.Step > 0;
+            Expression *Edge = Context.create<Expression>((int)(Up ? INT32_MIN + Offset : INT32_MAX + Offset));
+            Expression *Fits = Context.create<BooleanOp>(Up ? BooleanOp::GreaterEqual : BooleanOp::LessEqual, Limit, Edge);
+            llvm::SmallVector<Statement *> Guarded;
+            Guarded.push_back(Context.create<AssignStatement>(Limit, Context.create<BinaryOp>(BinaryOp::Minus, Limit, Context.create<Expression>((int)Offset))));
+            Guarded.push_back(Main);
+            Result.push_back(Context.create<IfStatement>(Fits, std::move(Guarded), llvm::SmallVector<ElseIfStatement *>(), nullptr,
+                                                         false, false, Statement::StatementType::If));
+        }
+
+        if (Trips < 0 || Trips % k != 0)
+        {
+            Expression *Condition = Context.create<BooleanOp>(Loop.Op, Loop.Iterator, Loop.Bound);
+            Result.push_back(Context.create<WhileStatement>(Condition, std::move(Epilogue), Statement::StatementType::While, true));
+        }
+        return true;
+    }
+
+    // Matches a for loop as a counted loop, its body being its statements
+    bool matchForLoop(ForStatement *forStatement, CountedLoop &Loop)
+    {
+        AssignStatement *Init = forStatement->getInitialAssign();
+        unsigned Var = Init->getLValue()->getSymbol();
+        if (!matchUpdate(forStatement->getUpdateAssign(), Var, Loop.Step) ||
+            !matchCondition(forStatement->getCondition(), Var, forStatement->getStatements(), Loop) ||
+            assignsVariable(forStatement->getStatements(), Var))
+            return false;
+        if (Init->getRValue()->isNumber())
+        {
+            Loop.HasInit = true;
+            Loop.Init = Init->getRValue()->getNumber();
+        }
+        return true;
+    }
+
+    // Matches a while loop as a counted loop. Its iterator is the variable of
+    // the condition the body steps exactly once, at UpdateIndex. Before are
+    // the statements preceding the loop, searched for the iterator's start.
+    bool matchWhileLoop(WhileStatement *whileStatement, llvm::ArrayRef<Statement *> Before, CountedLoop &Loop, size_t &UpdateIndex)
+    {
+        Expression *Condition = whileStatement->getCondition();
+        if (!Condition->isBooleanOp())
+            return false;
+        llvm::ArrayRef<Statement *> Stmts = whileStatement->getStatements();
+        for (Expression *Candidate : {((BooleanOp *)Condition)->getLeft(), ((BooleanOp *)Condition)->getRight()})
+        {
+            if (!Candidate->isVariable())
+                continue;
+            unsigned Var = Candidate->getSymbol();
+            Loop = CountedLoop();
+            if (!matchCondition(Condition, Var, Stmts, Loop))
+                continue;
+
+            UpdateIndex = Stmts.size();
+            for (size_t I = 0, E = Stmts.size(); I != E; ++I)
+            {
+                if (!assignsVariable(Stmts[I], Var))
+                    continue;
+                if (UpdateIndex != Stmts.size() || Stmts[I]->getKind() != Statement::StatementType::Assignment ||
+                    !matchUpdate((AssignStatement *)Stmts[I], Var, Loop.Step))
+                    return false;
+                UpdateIndex = I;
+            }
+            if (UpdateIndex == Stmts.size())
+                return false;
+            Loop.HasInit = findEntryValue(Before, Var, Loop.Init);
+            return true;
+        }
+        return false;
+    }
 }
 
+bool unrollLoop(ASTContext &Context, ForStatement *forStatement, const OptimizerOptions &Options,
+                llvm::SmallVectorImpl<Statement *> &Result, OptimizerStats &Stats)
+{
+    CountedLoop Loop;
+    if (!matchForLoop(forStatement, Loop))
+        return false;
+
+    llvm::ArrayRef<Statement *> Body = forStatement->getStatements();
+    llvm::SmallVector<Statement *> Epilogue(Body.begin(), Body.end());
+    Epilogue.push_back(forStatement->getUpdateAssign());
+    return unrollCountedLoop(Context, Loop, forStatement->getInitialAssign(), Body, Body.size(), std::move(Epilogue), Options, Result, Stats);
+}
+
+bool unrollLoop(ASTContext &Context, WhileStatement *whileStatement, llvm::ArrayRef<Statement *> Before,
+                const OptimizerOptions &Options, llvm::SmallVectorImpl<Statement *> &Result, OptimizerStats &Stats)
+{
+    CountedLoop Loop;
+    size_t UpdateIndex;
+    if (!matchWhileLoop(whileStatement, Before, Loop, UpdateIndex))
+        return false;
+
+    llvm::ArrayRef<Statement *> Stmts = whileStatement->getStatements();
+    llvm::SmallVector<Statement *> Body(Stmts.begin(), Stmts.begin() + UpdateIndex);
+    Body.append(Stmts.begin() + UpdateIndex + 1, Stmts.end());
+    llvm::SmallVector<Statement *> Epilogue(Stmts.begin(), Stmts.end());
+    return unrollCountedLoop(Context, Loop, nullptr, Body, UpdateIndex, std::move(Epilogue), Options, Result, Stats);
+}
 
-llvm::SmallVector<Statement *> completeUnroll(WhileStatement *whileStatement, int k)
+namespace
 {
-    llvm::SmallVector<Statement *> unrolledStatements;
-    llvm::SmallVector<Statement *> body = whileStatement->getStatements();
-    llvm::SmallVector<Statement *> newBody;
+    // Polynomial in the iterator, element K being the coefficient of i^K; nullptr is 0
+    typedef llvm::SmallVector<Expression *, 4> Polynomial;
+
+    // degree accepted when the trip count is known, otherwise only affine sums
+    const unsigned MaxReductionDegree = 3;
+
+    Expression *addTerms(ASTContext &Context, Expression *A, Expression *B)
+    {
+        if (!A || !B)
+            return A ? A : B;
+        return Context.create<BinaryOp>(BinaryOp::Plus, A, B);
+    }
+
+    Expression *multiplyTerms(ASTContext &Context, Expression *A, Expression *B)
+    {
+        if (!A || !B)
+            return nullptr;
+        return Context.create<BinaryOp>(BinaryOp::Mul, A, B);
+    }
 
-    BooleanOp *condition_boolean_op = (BooleanOp *)whileStatement->getCondition();
-    int conditionValue = condition_boolean_op->getRight()->getNumber();
-    int conditionValue_arash = conditionValue;
-    if(condition_boolean_op->getOperator() == BooleanOp::LessEqual){
-        conditionValue++;
+    void trimPolynomial(Polynomial &P)
+    {
+        while (!P.empty() && !P.back())
+            P.pop_back();
     }
-    llvm::StringRef iteratorVar = condition_boolean_op->getLeft()->getValue();
-    int initialIterator = 0;
-    int updateValue = 0;
-    // find initial value of iterator from the body
-    AssignStatement* updateValueStatement;
-    for(Statement *statement : body){
-        AssignStatement* assignStatement = (AssignStatement *)statement;
-        if(assignStatement->getLValue()->getValue() == iteratorVar){
-            updateValueStatement = assignStatement;
-            updateValue = ((BinaryOp *)assignStatement->getRValue())->getRight()->getNumber();
-            continue;
+
+    bool multiplyPolynomials(ASTContext &Context, const Polynomial &A, const Polynomial &B, unsigned MaxDegree, Polynomial &Result)
+    {
+        Polynomial Product;
+        if (!A.empty() && !B.empty())
+        {
+            if (A.size() + B.size() - 2 > MaxDegree)
+                return false;
+            Product.assign(A.size() + B.size() - 1, nullptr);
+            for (size_t I = 0; I != A.size(); ++I)
+                for (size_t J = 0; J != B.size(); ++J)
+                    Product[I + J] = addTerms(Context, Product[I + J], multiplyTerms(Context, A[I], B[J]));
         }
-        newBody.push_back(statement);
+        trimPolynomial(Product);
+        Result = std::move(Product);
+        return true;
     }
 
+    // Expresses Expr as a polynomial of the iterator Var whose coefficients
+    // are invariant in Stmts. Iterator is the polynomial a read of Var stands for.
+    bool toPolynomial(ASTContext &Context, Expression *Expr, unsigned Var, const Polynomial &Iterator,
+                      llvm::ArrayRef<Statement *> Stmts, unsigned MaxDegree, Polynomial &Result)
+    {
+        if (Expr->isVariable() && Expr->getSymbol() == Var)
+        {
+            Result = Iterator;
+            return true;
+        }
+        if (isLoopInvariant(Expr, Var, Stmts))
+        {
+            Result.assign(1, Expr);
+            return true;
+        }
+        if (!Expr->isBinaryOp())
+            return false;
+
+        BinaryOp *Node = (BinaryOp *)Expr;
+        Polynomial Left, Right;
+        if (!toPolynomial(Context, Node->getLeft(), Var, Iterator, Stmts, MaxDegree, Left))
+            return false;
+        if (Node->getOperator() == BinaryOp::Pow)
+        {
+            // i ^ 2 and i ^ 3
+            Expression *Exponent = Node->getRight();
+            if (!Exponent->isNumber() || Exponent->getNumber() < 1 || Exponent->getNumber() > (int)MaxDegree)
+                return false;
+            Result = Left;
+            for (int K = 1; K < Exponent->getNumber(); ++K)
+                if (!multiplyPolynomials(Context, Result, Left, MaxDegree, Result))
+                    return false;
+            return true;
+        }
+        if (!toPolynomial(Context, Node->getRight(), Var, Iterator, Stmts, MaxDegree, Right))
+            return false;
 
-    if(k > 0){
-        llvm::SmallVector<Statement *> newForBody;
-        for(Statement *statement : newBody){
-            for(int i = 0; i < k; i++){
-                AssignStatement* assignStatement = (AssignStatement *)statement;
-                Statement *newStatement = updateStatement(statement, iteratorVar, i * updateValue);
-                newForBody.push_back(newStatement);
+        switch (Node->getOperator())
+        {
+        case BinaryOp::Plus:
+        case BinaryOp::Minus:
+        {
+            bool IsMinus = Node->getOperator() == BinaryOp::Minus;
+            Result.assign(std::max(Left.size(), Right.size()), nullptr);
+            for (size_t K = 0; K != Result.size(); ++K)
+            {
+                Expression *A = K < Left.size() ? Left[K] : nullptr;
+                Expression *B = K < Right.size() ? Right[K] : nullptr;
+                if (IsMinus && B)
+                    B = Context.create<BinaryOp>(BinaryOp::Minus, Context.create<Expression>(0), B);
+                Result[K] = addTerms(Context, A, B);
             }
+            trimPolynomial(Result);
+            return true;
+        }
+        case BinaryOp::Mul:
+            return multiplyPolynomials(Context, Left, Right, MaxDegree, Result);
+        default:
+            return false;
         }
-        AssignStatement * newForUpdate = new AssignStatement(condition_boolean_op->getLeft(), new BinaryOp(BinaryOp::Plus, condition_boolean_op->getLeft(), new Expression(k * updateValue)));
-        Expression* newCondition = new BooleanOp(condition_boolean_op->getOperator(), condition_boolean_op->getLeft(), new Expression(conditionValue_arash - updateValue));
-        AssignStatement* newInitialAssign = new AssignStatement(condition_boolean_op->getLeft(), new Expression(0));
-        ForStatement* newForStatement = new ForStatement(newCondition, newForBody, newInitialAssign, newForUpdate, Statement::StatementType::For, true);
-        unrolledStatements.push_back(newForStatement);
-        if(conditionValue % (k * updateValue) != 0){
-             newBody.push_back(updateValueStatement);
-             WhileStatement* afterForStatement = new WhileStatement(whileStatement->getCondition(), newBody, Statement::StatementType::While, true);  
-             unrolledStatements.push_back(afterForStatement);
-         }
-        return unrolledStatements;
     }
-    for (int i = initialIterator; i < conditionValue; i += updateValue){
-        for (Statement *statement : newBody)
+
+    // sum of t^K over t in [0, N) modulo 2^32, dividing the factors of the
+    // usual formulas before multiplying so the result is exact
+    uint32_t sumOfPowers(unsigned K, uint64_t N)
+    {
+        if (N == 0)
+            return 0;
+        uint64_t A = N, B = N - 1, C = 2 * N - 1;
+        switch (K)
+        {
+        case 0:
+            return (uint32_t)N;
+        case 1:
+        case 3:
+        {
+            uint32_t Sum = A % 2 == 0 ? (uint32_t)(A / 2) * (uint32_t)B : (uint32_t)A * (uint32_t)(B / 2);
+            return K == 1 ? Sum : Sum * Sum;
+        }
+        case 2:
+        {
+            // N (N - 1) (2N - 1) / 6, one of A, B is even and one of A, B, C a multiple of 3
+            if (A % 2 == 0)
+                A /= 2;
+            else
+                B /= 2;
+            if (A % 3 == 0)
+                A /= 3;
+            else if (B % 3 == 0)
+                B /= 3;
+            else
+                C /= 3;
+            return (uint32_t)A * (uint32_t)B * (uint32_t)C;
+        }
+        }
+        return 0;
+    }
+
+    // sum of (Init + Step * t)^K over t in [0, N) modulo 2^32
+    uint32_t sumOfIteratorPowers(unsigned K, uint32_t Init, uint32_t Step, uint64_t N)
+    {
+        static const uint32_t Binomial[4][4] = {{1}, {1, 1}, {1, 2, 1}, {1, 3, 3, 1}};
+        uint32_t Sum = 0;
+        for (unsigned J = 0; J <= K; ++J)
+        {
+            uint32_t Term = Binomial[K][J] * sumOfPowers(J, N);
+            for (unsigned P = 0; P < K - J; ++P)
+                Term *= Init;
+            for (unsigned P = 0; P < J; ++P)
+                Term *= Step;
+            Sum += Term;
+        }
+        return Sum;
+    }
+
+    // Splits Expr into Var + Rest through chains of + and -, Rest being
+    // nullptr when Expr is Var itself
+    bool splitAccumulation(ASTContext &Context, Expression *Expr, unsigned Var, Expression *&Rest)
+    {
+        if (Expr->isVariable() && Expr->getSymbol() == Var)
+        {
+            Rest = nullptr;
+            return true;
+        }
+        if (!Expr->isBinaryOp())
+            return false;
+        BinaryOp *Node = (BinaryOp *)Expr;
+        BinaryOp::Operator Op = Node->getOperator();
+        if (Op != BinaryOp::Plus && Op != BinaryOp::Minus)
+            return false;
+        Expression *Inner;
+        if (splitAccumulation(Context, Node->getLeft(), Var, Inner))
+        {
+            if (Inner)
+                Rest = Context.create<BinaryOp>(Op, Inner, Node->getRight());
+            else
+                Rest = Op == BinaryOp::Plus ? Node->getRight() : Context.create<BinaryOp>(BinaryOp::Minus, Context.create<Expression>(0), Node->getRight());
+            return true;
+        }
+        if (Op == BinaryOp::Plus && splitAccumulation(Context, Node->getRight(), Var, Inner))
+        {
+            Rest = Inner ? Context.create<BinaryOp>(BinaryOp::Plus, Node->getLeft(), Inner) : Node->getLeft();
+            return true;
+        }
+        return false;
+    }
+
+    // (T / 2) * (T - 1) + (T % 2) * ((T - 1) / 2), T (T - 1) / 2 without losing bits to wrapping
+    Expression *createTriangular(ASTContext &Context, Expression *T)
+    {
+        Expression *Two = Context.create<Expression>(2);
+        Expression *Less = Context.create<BinaryOp>(BinaryOp::Minus, T, Context.create<Expression>(1));
+        Expression *Even = Context.create<BinaryOp>(BinaryOp::Mul, Context.create<BinaryOp>(BinaryOp::Div, T, Two), Less);
+        Expression *Odd = Context.create<BinaryOp>(BinaryOp::Mul, Context.create<BinaryOp>(BinaryOp::Mod, T, Two),
+                                                   Context.create<BinaryOp>(BinaryOp::Div, Less, Two));
+        return Context.create<BinaryOp>(BinaryOp::Plus, Even, Odd);
+    }
+
+    // Replaces a counted loop whose body only adds polynomials of the
+    // iterator to accumulators by their sums. Stmts is the whole body,
+    // UpdateIndex the position of a while loop's step or Stmts.size().
+    // Original runs instead when a runtime guard fails.
+    bool reduceCountedLoop(ASTContext &Context, CountedLoop &Loop, Statement *Original, llvm::ArrayRef<Statement *> Stmts,
+                           size_t UpdateIndex, llvm::SmallVectorImpl<Statement *> &Result, OptimizerStats &Stats)
+    {
+        int64_t Trips;
+        if (!checkDirection(Loop, Trips))
+            return false;
+
+        // statements after the step see the iterator one step further
+        unsigned Var = Loop.Iterator->getSymbol();
+        unsigned MaxDegree = Trips >= 0 ? MaxReductionDegree : 1;
+        Polynomial Before = {nullptr, Context.create<Expression>(1)};
+        Polynomial After = {Context.create<Expression>((int)Loop.Step), Context.create<Expression>(1)};
+        llvm::SmallVector<std::pair<AssignStatement *, Polynomial>> Sums;
+        for (size_t I = 0, E = Stmts.size(); I != E; ++I)
+        {
+            if (I == UpdateIndex)
+                continue;
+            // X = X + E with E a polynomial of the iterator
+            if (Stmts[I]->getKind() != Statement::StatementType::Assignment)
+                return false;
+            AssignStatement *Target = (AssignStatement *)Stmts[I];
+            Expression *Addend;
+            Polynomial Sum;
+            if (!splitAccumulation(Context, Target->getRValue(), Target->getLValue()->getSymbol(), Addend))
+                return false;
+            if (Addend && !toPolynomial(Context, Addend, Var, I > UpdateIndex ? After : Before, Stmts, MaxDegree, Sum))
+                return false;
+            Sums.push_back({Target, std::move(Sum)});
+        }
+
+        auto accumulate = [&](llvm::SmallVectorImpl<Statement *> &Into, Expression *Total, AssignStatement *Target)
+        {
+            if (Total)
+                Into.push_back(Context.create<AssignStatement>(Target->getLValue(), Context.create<BinaryOp>(BinaryOp::Plus, Target->getLValue(), Total)));
+        };
+
+        ForStatement *forStatement = Original->getKind() == Statement::StatementType::For ? (ForStatement *)Original : nullptr;
+        if (forStatement)
+            Result.push_back(forStatement->getInitialAssign());
+        if (Trips >= 0)
+        {
+            // every power sum is a literal
+            for (auto &Sum : Sums)
+            {
+                Expression *Total = nullptr;
+                for (unsigned K = 0; K != Sum.second.size(); ++K)
+                {
+                    uint32_t Powers = sumOfIteratorPowers(K, Loop.Init, Loop.Step, Trips);
+                    if (Powers)
+                        Total = addTerms(Context, Total, multiplyTerms(Context, Sum.second[K], Context.create<Expression>((int)Powers)));
+                }
+                accumulate(Result, Total, Sum.first);
+            }
+            Result.push_back(Context.create<AssignStatement>(Loop.Iterator, Context.create<Expression>((int)(Loop.Init + Trips * Loop.Step))));
+            ++Stats.ReducedLoops;
+            return true;
+        }
+
+        // Runs the sums when the loop is entered, the distance to the bound
+        // cannot wrap (one end is on the matching side of zero) and neither
+        // can the last step of the iterator. Otherwise the loop runs as is.
+        bool Up = Loop.Step > 0;
+        bool Strict = Loop.Op == BooleanOp::Less || Loop.Op == BooleanOp::Greater;
+        Expression *Iterator = Loop.Iterator, *Bound = Loop.Bound;
+        Expression *Zero = Context.create<Expression>(0);
+        Expression *Entered = Context.create<BooleanOp>(Loop.Op, Iterator, Bound);
+        Expression *NoWrap = Up ? Context.create<BooleanOp>(BooleanOp::LessEqual, Bound, Context.create<Expression>((int)(INT32_MAX - Loop.Step + Strict)))
+                                : Context.create<BooleanOp>(BooleanOp::GreaterEqual, Bound, Context.create<Expression>((int)(INT32_MIN - Loop.Step - Strict)));
+        Expression *Low = Up ? Iterator : Bound, *High = Up ? Bound : Iterator;
+        Expression *Fits = Context.create<BooleanOp>(BooleanOp::Or, Context.create<BooleanOp>(BooleanOp::GreaterEqual, Low, Zero),
+                                                     Context.create<BooleanOp>(BooleanOp::Less, High, Zero));
+        Expression *Guard = Context.create<BooleanOp>(BooleanOp::And, Context.create<BooleanOp>(BooleanOp::And, Entered, NoWrap), Fits);
+
+        // trips = (High - Low - Strict) / |Step| + 1
+        SymbolTable &Symbols = Context.getSymbols();
+        unsigned Temp = Symbols.intern(("reduce.trips" + llvm::Twine(Symbols.size())).str());
+        Expression *T = Context.create<Expression>(Symbols.getName(Temp), Temp);
+        Expression *Distance = Context.create<BinaryOp>(BinaryOp::Minus, High, Low);
+        if (Strict)
+            Distance = Context.create<BinaryOp>(BinaryOp::Minus, Distance, Context.create<Expression>(1));
+        int32_t AbsStep = Up ? Loop.Step : -Loop.Step;
+        Expression *Count = Context.create<BinaryOp>(BinaryOp::Plus, Context.create<BinaryOp>(BinaryOp::Div, Distance, Context.create<Expression>((int)AbsStep)),
+                                                     Context.create<Expression>(1));
+        llvm::SmallVector<Statement *> Then;
+        Then.push_back(Context.create<DecStatement>(T, Count, DecStatement::DecStatementType::Number));
+
+        // sum of c0 + c1 * i is c0 * T + c1 * (T * i + Step * T (T - 1) / 2)
+        Expression *Triangular = nullptr;
+        for (auto &Sum : Sums)
+        {
+            Expression *Total = multiplyTerms(Context, Sum.second.empty() ? nullptr : Sum.second[0], T);
+            if (Sum.second.size() > 1)
+            {
+                if (!Triangular)
+                    Triangular = createTriangular(Context, T);
+                Expression *Linear = Context.create<BinaryOp>(BinaryOp::Plus, Context.create<BinaryOp>(BinaryOp::Mul, T, Iterator),
+                                                              Context.create<BinaryOp>(BinaryOp::Mul, Context.create<Expression>((int)Loop.Step), Triangular));
+                Total = addTerms(Context, Total, multiplyTerms(Context, Sum.second[1], Linear));
+            }
+            accumulate(Then, Total, Sum.first);
+        }
+        Then.push_back(Context.create<AssignStatement>(Iterator, Context.create<BinaryOp>(BinaryOp::Plus, Iterator,
+                                                                                         Context.create<BinaryOp>(BinaryOp::Mul, T, Context.create<Expression>((int)Loop.Step)))));
+
+        // the fallback must not run the initial assignment of a for loop again
+        llvm::SmallVector<Statement *> Else;
+        if (forStatement)
+        {
+            llvm::SmallVector<Statement *> Body(Stmts.begin(), Stmts.end());
+            Body.push_back(forStatement->getUpdateAssign());
+            Original = Context.create<WhileStatement>(forStatement->getCondition(), std::move(Body), Statement::StatementType::While);
+        }
+        Else.push_back(Original);
+        Result.push_back(Context.create<IfStatement>(Guard, std::move(Then), llvm::SmallVector<ElseIfStatement *>(),
+                                                     Context.create<ElseStatement>(std::move(Else), Statement::StatementType::Else),
+                                                     false, true, Statement::StatementType::If));
+        ++Stats.ReducedLoops;
+        return true;
+    }
+
+    llvm::SmallVector<Statement *> reduceLoops(ASTContext &Context, llvm::ArrayRef<Statement *> Stmts, OptimizerStats &Stats)
+    {
+        llvm::SmallVector<Statement *> Result;
+        for (Statement *Stmt : Stmts)
+        {
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                ifStatement->setStatements(reduceLoops(Context, ifStatement->getStatements(), Stats));
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    elseIf->setStatements(reduceLoops(Context, elseIf->getStatements(), Stats));
+                if (ifStatement->HasElse())
+                    ifStatement->getElseStatement()->setStatements(reduceLoops(Context, ifStatement->getElseStatement()->getStatements(), Stats));
+                break;
+            }
+            case Statement::StatementType::While:
+            {
+                WhileStatement *whileStatement = (WhileStatement *)Stmt;
+                whileStatement->setStatements(reduceLoops(Context, whileStatement->getStatements(), Stats));
+                CountedLoop Loop;
+                size_t UpdateIndex;
+                if (matchWhileLoop(whileStatement, Result, Loop, UpdateIndex) &&
+                    reduceCountedLoop(Context, Loop, whileStatement, whileStatement->getStatements(), UpdateIndex, Result, Stats))
+                    continue;
+                break;
+            }
+            case Statement::StatementType::For:
+            {
+                ForStatement *forStatement = (ForStatement *)Stmt;
+                forStatement->setStatements(reduceLoops(Context, forStatement->getStatements(), Stats));
+                CountedLoop Loop;
+                llvm::ArrayRef<Statement *> Body = forStatement->getStatements();
+                if (matchForLoop(forStatement, Loop) &&
+                    reduceCountedLoop(Context, Loop, forStatement, Body, Body.size(), Result, Stats))
+                    continue;
+                break;
+            }
+            default:
+                break;
+            }
+            Result.push_back(Stmt);
+        }
+        return Result;
+    }
+}
+
+void reduceLoops(ASTContext &Context, Base *Tree, OptimizerStats &Stats)
+{
+    Tree->setStatements(reduceLoops(Context, Tree->getStatements(), Stats));
+}
+
+bool evaluateBinaryOp(BinaryOp::Operator Op, int32_t Left, int32_t Right, int32_t &Result)
+{
+    uint32_t L = Left, R = Right;
+    switch (Op)
+    {
+    case BinaryOp::Plus:
+        Result = (int32_t)(L + R);
+        return true;
+    case BinaryOp::Minus:
+        Result = (int32_t)(L - R);
+        return true;
+    case BinaryOp::Mul:
+        Result = (int32_t)(L * R);
+        return true;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+        if (Right == 0 || (Left == INT32_MIN && Right == -1))
+            return false;
+        Result = Op == BinaryOp::Div ? Left / Right : Left % Right;
+        return true;
+    case BinaryOp::Pow:
+    {
+        // square-and-multiply with the same wrapping and e <= 0 -> 1 rule as codegen
+        uint32_t Value = 1, Square = L;
+        for (int32_t E = Right; E > 0; E >>= 1)
         {
-            Statement *newStatement = updateStatement(statement, iteratorVar, i);
-            unrolledStatements.push_back(newStatement);
+            if (E & 1)
+                Value *= Square;
+            Square *= Square;
         }
+        Result = (int32_t)Value;
+        return true;
     }
-    return unrolledStatements;
+    }
+    return false;
+}
+
+bool evaluateComparison(BooleanOp::Operator Op, int32_t Left, int32_t Right)
+{
+    switch (Op)
+    {
+    case BooleanOp::Equal:
+        return Left == Right;
+    case BooleanOp::NotEqual:
+        return Left != Right;
+    case BooleanOp::Less:
+        return Left < Right;
+    case BooleanOp::LessEqual:
+        return Left <= Right;
+    case BooleanOp::Greater:
+        return Left > Right;
+    case BooleanOp::GreaterEqual:
+        return Left >= Right;
+    case BooleanOp::And:
+        return Left && Right;
+    case BooleanOp::Or:
+        return Left || Right;
+    }
+    return false;
 }
 
 // for(i 0 ta 10){
 // x = x + 1;
 
 // }
+
+namespace
+{
+    unsigned countNodes(Expression *Expr)
+    {
+        if (Expr->isBinaryOp())
+            return 1 + countNodes(((BinaryOp *)Expr)->getLeft()) + countNodes(((BinaryOp *)Expr)->getRight());
+        if (Expr->isBooleanOp())
+            return 1 + countNodes(((BooleanOp *)Expr)->getLeft()) + countNodes(((BooleanOp *)Expr)->getRight());
+        return 1;
+    }
+
+    unsigned countNodes(Statement *Stmt)
+    {
+        switch (Stmt->getKind())
+        {
+        case Statement::StatementType::Declaration:
+        {
+            DecStatement *declaration = (DecStatement *)Stmt;
+            return 2 + (declaration->getRValue() ? countNodes(declaration->getRValue()) : 0);
+        }
+        case Statement::StatementType::Assignment:
+            return 2 + countNodes(((AssignStatement *)Stmt)->getRValue());
+        case Statement::StatementType::Print:
+            return 1 + countNodes(((PrintStatement *)Stmt)->getExpr());
+        case Statement::StatementType::If:
+        {
+            IfStatement *ifStatement = (IfStatement *)Stmt;
+            unsigned Count = 1 + countNodes(ifStatement->getCondition()) + countNodes(ifStatement->getStatements());
+            for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                Count += countNodes(elseIf);
+            if (ifStatement->HasElse())
+                Count += countNodes(ifStatement->getElseStatement());
+            return Count;
+        }
+        case Statement::StatementType::ElseIf:
+        {
+            ElseIfStatement *elseIf = (ElseIfStatement *)Stmt;
+            return 1 + countNodes(elseIf->getCondition()) + countNodes(elseIf->getStatements());
+        }
+        case Statement::StatementType::Else:
+            return 1 + countNodes(((ElseStatement *)Stmt)->getStatements());
+        case Statement::StatementType::While:
+        {
+            WhileStatement *whileStatement = (WhileStatement *)Stmt;
+            return 1 + countNodes(whileStatement->getCondition()) + countNodes(whileStatement->getStatements());
+        }
+        case Statement::StatementType::For:
+        {
+            ForStatement *forStatement = (ForStatement *)Stmt;
+            return 1 + countNodes(forStatement->getInitialAssign()) + countNodes(forStatement->getCondition()) +
+                   countNodes(forStatement->getUpdateAssign()) + countNodes(forStatement->getStatements());
+        }
+        }
+        return 1;
+    }
+
+    // Marks every variable written by Stmts in Assigned (indexed by symbol)
+    void collectAssigned(llvm::ArrayRef<Statement *> Stmts, std::vector<char> &Assigned)
+    {
+        for (Statement *Stmt : Stmts)
+        {
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::Declaration:
+                Assigned[((DecStatement *)Stmt)->getLValue()->getSymbol()] = true;
+                break;
+            case Statement::StatementType::Assignment:
+                Assigned[((AssignStatement *)Stmt)->getLValue()->getSymbol()] = true;
+                break;
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                collectAssigned(ifStatement->getStatements(), Assigned);
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    collectAssigned(elseIf->getStatements(), Assigned);
+                if (ifStatement->HasElse())
+                    collectAssigned(ifStatement->getElseStatement()->getStatements(), Assigned);
+                break;
+            }
+            case Statement::StatementType::While:
+                collectAssigned(((WhileStatement *)Stmt)->getStatements(), Assigned);
+                break;
+            case Statement::StatementType::For:
+            {
+                ForStatement *forStatement = (ForStatement *)Stmt;
+                Assigned[forStatement->getInitialAssign()->getLValue()->getSymbol()] = true;
+                Assigned[forStatement->getUpdateAssign()->getLValue()->getSymbol()] = true;
+                collectAssigned(forStatement->getStatements(), Assigned);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    // Flow-sensitive constant propagation and folding. Known maps every
+    // symbol to the literal it currently holds, or nullptr when unknown.
+    class ConstantPropagation
+    {
+        ASTContext &Context;
+        OptimizerStats &Stats;
+        std::vector<Expression *> Known;
+
+        bool isLiteral(Expression *Expr) { return Expr->isNumber() || Expr->isBoolean(); }
+
+        Expression *foldBinary(BinaryOp *Node)
+        {
+            Expression *Left = fold(Node->getLeft());
+            Expression *Right = fold(Node->getRight());
+            BinaryOp::Operator Op = Node->getOperator();
+
+            int32_t Result;
+            if (Left->isNumber() && Right->isNumber() && evaluateBinaryOp(Op, Left->getNumber(), Right->getNumber(), Result))
+            {
+                ++Stats.FoldedExpressions;
+                return Context.create<Expression>((int)Result);
+            }
+
+            // x + 0, 0 + x, x - 0, x * 1, 1 * x and x ^ 1 are x
+            bool LeftIs = false, RightIs = false;
+            if (Op == BinaryOp::Plus)
+                LeftIs = Right->isNumber() && Right->getNumber() == 0, RightIs = Left->isNumber() && Left->getNumber() == 0;
+            else if (Op == BinaryOp::Minus)
+                LeftIs = Right->isNumber() && Right->getNumber() == 0;
+            else if (Op == BinaryOp::Mul)
+                LeftIs = Right->isNumber() && Right->getNumber() == 1, RightIs = Left->isNumber() && Left->getNumber() == 1;
+            else if (Op == BinaryOp::Pow)
+                LeftIs = Right->isNumber() && Right->getNumber() == 1;
+            if (LeftIs || RightIs)
+            {
+                ++Stats.FoldedExpressions;
+                return LeftIs ? Left : Right;
+            }
+
+            // (x + c1) + c2 -> x + (c1 + c2), the unroller builds these chains
+            if (Op == BinaryOp::Plus && Right->isNumber() && Left->isBinaryOp())
+            {
+                BinaryOp *Inner = (BinaryOp *)Left;
+                if (Inner->getOperator() == BinaryOp::Plus && Inner->getRight()->isNumber())
+                {
+                    ++Stats.FoldedExpressions;
+                    int32_t Sum = (int32_t)((uint32_t)Inner->getRight()->getNumber() + (uint32_t)Right->getNumber());
+                    if (Sum == 0)
+                        return Inner->getLeft();
+                    return Context.create<BinaryOp>(BinaryOp::Plus, Inner->getLeft(), Context.create<Expression>((int)Sum));
+                }
+            }
+
+            if (Left == Node->getLeft() && Right == Node->getRight())
+                return Node;
+            return Context.create<BinaryOp>(Op, Left, Right);
+        }
+
+        Expression *foldBoolean(BooleanOp *Node)
+        {
+            Expression *Left = fold(Node->getLeft());
+            Expression *Right = fold(Node->getRight());
+            BooleanOp::Operator Op = Node->getOperator();
+
+            if (Op == BooleanOp::And || Op == BooleanOp::Or)
+            {
+                // a literal operand either decides the result or drops out
+                bool isAnd = Op == BooleanOp::And;
+                if (Left->isBoolean())
+                {
+                    ++Stats.FoldedExpressions;
+                    return Left->getBoolean() == isAnd ? Right : Left;
+                }
+                if (Right->isBoolean() && Right->getBoolean() == isAnd)
+                {
+                    ++Stats.FoldedExpressions;
+                    return Left;
+                }
+            }
+            else if (isLiteral(Left) && isLiteral(Right))
+            {
+                int32_t L = Left->isNumber() ? Left->getNumber() : Left->getBoolean();
+                int32_t R = Right->isNumber() ? Right->getNumber() : Right->getBoolean();
+                ++Stats.FoldedExpressions;
+                return Context.create<Expression>(evaluateComparison(Op, L, R));
+            }
+
+            if (Left == Node->getLeft() && Right == Node->getRight())
+                return Node;
+            return Context.create<BooleanOp>(Op, Left, Right);
+        }
+
+        Expression *fold(Expression *Expr)
+        {
+            if (Expr->isVariable())
+            {
+                if (Expression *Value = Known[Expr->getSymbol()])
+                {
+                    ++Stats.PropagatedConstants;
+                    return Value;
+                }
+                return Expr;
+            }
+            if (Expr->isBinaryOp())
+                return foldBinary((BinaryOp *)Expr);
+            if (Expr->isBooleanOp())
+                return foldBoolean((BooleanOp *)Expr);
+            return Expr;
+        }
+
+        void assign(Expression *LValue, Expression *Value)
+        {
+            Known[LValue->getSymbol()] = isLiteral(Value) ? Value : nullptr;
+        }
+
+        // forget everything the loop body may change, it runs an unknown number of times
+        void killAssigned(llvm::ArrayRef<Statement *> Stmts)
+        {
+            std::vector<char> Assigned(Known.size(), false);
+            collectAssigned(Stmts, Assigned);
+            for (size_t I = 0, E = Known.size(); I != E; ++I)
+                if (Assigned[I])
+                    Known[I] = nullptr;
+        }
+
+        // keeps only the values every branch agrees on
+        void merge(std::vector<Expression *> &Into, const std::vector<Expression *> &Other)
+        {
+            for (size_t I = 0, E = Into.size(); I != E; ++I)
+            {
+                Expression *A = Into[I], *B = Other[I];
+                if (A == B || !A || !B)
+                {
+                    if (A != B)
+                        Into[I] = nullptr;
+                    continue;
+                }
+                bool Same = A->isNumber() ? B->isNumber() && A->getNumber() == B->getNumber()
+                                          : B->isBoolean() && A->getBoolean() == B->getBoolean();
+                if (!Same)
+                    Into[I] = nullptr;
+            }
+        }
+
+        void visitIf(IfStatement *Node)
+        {
+            Node->setCondition(fold(Node->getCondition()));
+            std::vector<Expression *> Entry = Known;
+            visitStatements(Node->getStatements());
+            std::vector<Expression *> Result = std::move(Known);
+
+            for (ElseIfStatement *elseIf : Node->getElseIfStatements())
+            {
+                Known = Entry;
+                elseIf->setCondition(fold(elseIf->getCondition()));
+                Entry = Known;
+                visitStatements(elseIf->getStatements());
+                merge(Result, Known);
+            }
+
+            Known = std::move(Entry);
+            if (Node->HasElse())
+                visitStatements(Node->getElseStatement()->getStatements());
+            merge(Known, Result);
+        }
+
+    public:
+        ConstantPropagation(ASTContext &Context, OptimizerStats &Stats)
+            : Context(Context), Stats(Stats), Known(Context.getSymbols().size(), nullptr) {}
+
+        void visitStatements(llvm::ArrayRef<Statement *> Stmts)
+        {
+            for (Statement *Stmt : Stmts)
+            {
+                switch (Stmt->getKind())
+                {
+                case Statement::StatementType::Declaration:
+                {
+                    DecStatement *declaration = (DecStatement *)Stmt;
+                    if (declaration->getRValue())
+                        declaration->setRValue(fold(declaration->getRValue()));
+                    // an uninitialized declaration is zero or false
+                    Expression *Value = declaration->getRValue();
+                    if (!Value)
+                        Value = declaration->getDecType() == DecStatement::DecStatementType::Number
+                                    ? Context.create<Expression>(0)
+                                    : Context.create<Expression>(false);
+                    assign(declaration->getLValue(), Value);
+                    break;
+                }
+                case Statement::StatementType::Assignment:
+                {
+                    AssignStatement *assignment = (AssignStatement *)Stmt;
+                    assignment->setRValue(fold(assignment->getRValue()));
+                    assign(assignment->getLValue(), assignment->getRValue());
+                    break;
+                }
+                case Statement::StatementType::Print:
+                {
+                    PrintStatement *print = (PrintStatement *)Stmt;
+                    print->setExpr(fold(print->getExpr()));
+                    break;
+                }
+                case Statement::StatementType::If:
+                    visitIf((IfStatement *)Stmt);
+                    break;
+                case Statement::StatementType::While:
+                {
+                    WhileStatement *whileStatement = (WhileStatement *)Stmt;
+                    killAssigned(whileStatement->getStatements());
+                    whileStatement->setCondition(fold(whileStatement->getCondition()));
+                    std::vector<Expression *> Exit = Known;
+                    visitStatements(whileStatement->getStatements());
+                    Known = std::move(Exit);
+                    break;
+                }
+                case Statement::StatementType::For:
+                {
+                    ForStatement *forStatement = (ForStatement *)Stmt;
+                    AssignStatement *initial = forStatement->getInitialAssign();
+                    initial->setRValue(fold(initial->getRValue()));
+                    assign(initial->getLValue(), initial->getRValue());
+
+                    Statement *Update = forStatement->getUpdateAssign();
+                    killAssigned(forStatement->getStatements());
+                    killAssigned(Update);
+                    forStatement->setCondition(fold(forStatement->getCondition()));
+                    std::vector<Expression *> Exit = Known;
+                    visitStatements(forStatement->getStatements());
+                    forStatement->getUpdateAssign()->setRValue(fold(forStatement->getUpdateAssign()->getRValue()));
+                    Known = std::move(Exit);
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+    };
+
+    // Replaces loops by the unroller's output, recursing into nested bodies
+    llvm::SmallVector<Statement *> unrollLoops(ASTContext &Context, llvm::ArrayRef<Statement *> Stmts,
+                                               const OptimizerOptions &Options, OptimizerStats &Stats);
+
+    void unrollNested(ASTContext &Context, Statement *Stmt, const OptimizerOptions &Options, OptimizerStats &Stats)
+    {
+        switch (Stmt->getKind())
+        {
+        case Statement::StatementType::If:
+        {
+            IfStatement *ifStatement = (IfStatement *)Stmt;
+            ifStatement->setStatements(unrollLoops(Context, ifStatement->getStatements(), Options, Stats));
+            for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                elseIf->setStatements(unrollLoops(Context, elseIf->getStatements(), Options, Stats));
+            if (ifStatement->HasElse())
+                ifStatement->getElseStatement()->setStatements(
+                    unrollLoops(Context, ifStatement->getElseStatement()->getStatements(), Options, Stats));
+            break;
+        }
+        case Statement::StatementType::While:
+            ((WhileStatement *)Stmt)->setStatements(unrollLoops(Context, ((WhileStatement *)Stmt)->getStatements(), Options, Stats));
+            break;
+        case Statement::StatementType::For:
+            ((ForStatement *)Stmt)->setStatements(unrollLoops(Context, ((ForStatement *)Stmt)->getStatements(), Options, Stats));
+            break;
+        default:
+            break;
+        }
+    }
+
+    llvm::SmallVector<Statement *> unrollLoops(ASTContext &Context, llvm::ArrayRef<Statement *> Stmts,
+                                               const OptimizerOptions &Options, OptimizerStats &Stats)
+    {
+        llvm::SmallVector<Statement *> Result;
+        // statements still to visit, the next one last
+        llvm::SmallVector<Statement *> Pending(Stmts.rbegin(), Stmts.rend());
+        while (!Pending.empty())
+        {
+            Statement *Stmt = Pending.pop_back_val();
+            size_t First = Result.size();
+            bool Unrolled = false;
+            if (Stmt->getKind() == Statement::StatementType::For && !((ForStatement *)Stmt)->isOptimized())
+                Unrolled = unrollLoop(Context, (ForStatement *)Stmt, Options, Result, Stats);
+            else if (Stmt->getKind() == Statement::StatementType::While && !((WhileStatement *)Stmt)->isOptimized())
+                Unrolled = unrollLoop(Context, (WhileStatement *)Stmt, Result, Options, Result, Stats);
+            if (!Unrolled)
+            {
+                // loops the unroller cannot prove safe are kept, but their bodies are still visited
+                Result.push_back(Stmt);
+                unrollNested(Context, Stmt, Options, Stats);
+                continue;
+            }
+            ++Stats.UnrolledLoops;
+
+            // Visit the replacement like the original statements, so copies of
+            // loops nested in a completely unrolled one get unrolled too. The
+            // unrolled and remainder loops are marked and not unrolled again.
+            for (size_t I = Result.size(); I-- != First;)
+                Pending.push_back(Result[I]);
+            Result.resize(First);
+        }
+        return Result;
+    }
+
+    // true if evaluating Expr can trap: a division or modulo by anything but a
+    // literal other than 0 and -1. Code that cannot trap may run speculatively
+    // or be dropped when its value is not needed.
+    bool mayTrap(Expression *Expr)
+    {
+        if (Expr->isBinaryOp())
+        {
+            BinaryOp *binaryOp = (BinaryOp *)Expr;
+            if (binaryOp->getOperator() == BinaryOp::Div || binaryOp->getOperator() == BinaryOp::Mod)
+            {
+                Expression *Divisor = binaryOp->getRight();
+                if (!Divisor->isNumber() || Divisor->getNumber() == 0 || Divisor->getNumber() == -1)
+                    return true;
+            }
+            return mayTrap(binaryOp->getLeft()) || mayTrap(binaryOp->getRight());
+        }
+        if (Expr->isBooleanOp())
+            return mayTrap(((BooleanOp *)Expr)->getLeft()) || mayTrap(((BooleanOp *)Expr)->getRight());
+        return false;
+    }
+
+    bool sameExpression(Expression *A, Expression *B)
+    {
+        if (A == B)
+            return true;
+        if (A->getKind() != B->getKind())
+            return false;
+        if (A->isNumber())
+            return A->getNumber() == B->getNumber();
+        if (A->isVariable())
+            return A->getSymbol() == B->getSymbol();
+        if (A->isBinaryOp())
+            return ((BinaryOp *)A)->getOperator() == ((BinaryOp *)B)->getOperator() &&
+                   sameExpression(((BinaryOp *)A)->getLeft(), ((BinaryOp *)B)->getLeft()) &&
+                   sameExpression(((BinaryOp *)A)->getRight(), ((BinaryOp *)B)->getRight());
+        return false;
+    }
+
+    // Loop-invariant code motion. Arithmetic whose variables are written
+    // nowhere in a loop is computed once into a temporary declared in front
+    // of it. Outer loops are visited first so a subtree invariant in several
+    // nested loops moves out of all of them at once.
+    class InvariantMotion
+    {
+        ASTContext &Context;
+        OptimizerStats &Stats;
+        std::vector<char> Assigned; // variables the current loop writes
+        llvm::SmallVector<std::pair<Expression *, Expression *>> Hoisted; // subtree, temporary
+        llvm::SmallVectorImpl<Statement *> *Preheader = nullptr;
+
+        bool isInvariant(Expression *Expr)
+        {
+            if (Expr->isVariable())
+                return Expr->getSymbol() < Assigned.size() && !Assigned[Expr->getSymbol()];
+            if (Expr->isBinaryOp())
+                return isInvariant(((BinaryOp *)Expr)->getLeft()) && isInvariant(((BinaryOp *)Expr)->getRight());
+            return Expr->isNumber();
+        }
+
+        bool readsVariable(Expression *Expr)
+        {
+            if (Expr->isBinaryOp())
+                return readsVariable(((BinaryOp *)Expr)->getLeft()) || readsVariable(((BinaryOp *)Expr)->getRight());
+            return Expr->isVariable();
+        }
+
+        Expression *hoist(Expression *Expr)
+        {
+            for (auto &Entry : Hoisted)
+                if (sameExpression(Entry.first, Expr))
+                    return Entry.second;
+            SymbolTable &Symbols = Context.getSymbols();
+            unsigned Temp = Symbols.intern(("licm.t" + llvm::Twine(Symbols.size())).str());
+            Expression *T = Context.create<Expression>(Symbols.getName(Temp), Temp);
+            Preheader->push_back(Context.create<DecStatement>(T, Expr, DecStatement::DecStatementType::Number));
+            Hoisted.push_back({Expr, T});
+            ++Stats.HoistedExpressions;
+            return T;
+        }
+
+        // Speculative is set for code that does not run on every entry to the loop
+        Expression *visit(Expression *Expr, bool Speculative)
+        {
+            if (Expr->isBinaryOp())
+            {
+                if (isInvariant(Expr) && readsVariable(Expr) && (!Speculative || !mayTrap(Expr)))
+                    return hoist(Expr);
+                BinaryOp *binaryOp = (BinaryOp *)Expr;
+                Expression *Left = visit(binaryOp->getLeft(), Speculative);
+                Expression *Right = visit(binaryOp->getRight(), Speculative);
+                if (Left == binaryOp->getLeft() && Right == binaryOp->getRight())
+                    return Expr;
+                return Context.create<BinaryOp>(binaryOp->getOperator(), Left, Right);
+            }
+            if (Expr->isBooleanOp())
+            {
+                // the right operand of and / or is skipped when the left one decides
+                BooleanOp *booleanOp = (BooleanOp *)Expr;
+                bool ShortCircuit = booleanOp->getOperator() == BooleanOp::And || booleanOp->getOperator() == BooleanOp::Or;
+                Expression *Left = visit(booleanOp->getLeft(), Speculative);
+                Expression *Right = visit(booleanOp->getRight(), Speculative || ShortCircuit);
+                if (Left == booleanOp->getLeft() && Right == booleanOp->getRight())
+                    return Expr;
+                return Context.create<BooleanOp>(booleanOp->getOperator(), Left, Right);
+            }
+            return Expr;
+        }
+
+        // the body of a loop may not run at all, so everything in it is speculative
+        void visitBody(llvm::ArrayRef<Statement *> Stmts)
+        {
+            for (Statement *Stmt : Stmts)
+            {
+                switch (Stmt->getKind())
+                {
+                case Statement::StatementType::Declaration:
+                {
+                    DecStatement *declaration = (DecStatement *)Stmt;
+                    if (declaration->getRValue())
+                        declaration->setRValue(visit(declaration->getRValue(), true));
+                    break;
+                }
+                case Statement::StatementType::Assignment:
+                {
+                    AssignStatement *assignment = (AssignStatement *)Stmt;
+                    assignment->setRValue(visit(assignment->getRValue(), true));
+                    break;
+                }
+                case Statement::StatementType::If:
+                {
+                    IfStatement *ifStatement = (IfStatement *)Stmt;
+                    ifStatement->setCondition(visit(ifStatement->getCondition(), true));
+                    visitBody(ifStatement->getStatements());
+                    for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    {
+                        elseIf->setCondition(visit(elseIf->getCondition(), true));
+                        visitBody(elseIf->getStatements());
+                    }
+                    if (ifStatement->HasElse())
+                        visitBody(ifStatement->getElseStatement()->getStatements());
+                    break;
+                }
+                case Statement::StatementType::While:
+                {
+                    WhileStatement *whileStatement = (WhileStatement *)Stmt;
+                    whileStatement->setCondition(visit(whileStatement->getCondition(), true));
+                    visitBody(whileStatement->getStatements());
+                    break;
+                }
+                case Statement::StatementType::For:
+                {
+                    ForStatement *forStatement = (ForStatement *)Stmt;
+                    AssignStatement *initial = forStatement->getInitialAssign();
+                    initial->setRValue(visit(initial->getRValue(), true));
+                    forStatement->setCondition(visit(forStatement->getCondition(), true));
+                    AssignStatement *update = forStatement->getUpdateAssign();
+                    update->setRValue(visit(update->getRValue(), true));
+                    visitBody(forStatement->getStatements());
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+
+        // hoists out of Loop, appending the temporaries to Result
+        void visitLoop(Statement *Loop, llvm::SmallVectorImpl<Statement *> &Result)
+        {
+            Assigned.assign(Context.getSymbols().size(), false);
+            collectAssigned(Loop, Assigned);
+            Hoisted.clear();
+            Preheader = &Result;
+            // the condition is evaluated every time the loop is reached
+            if (Loop->getKind() == Statement::StatementType::While)
+            {
+                WhileStatement *whileStatement = (WhileStatement *)Loop;
+                whileStatement->setCondition(visit(whileStatement->getCondition(), false));
+                visitBody(whileStatement->getStatements());
+            }
+            else
+            {
+                ForStatement *forStatement = (ForStatement *)Loop;
+                forStatement->setCondition(visit(forStatement->getCondition(), false));
+                AssignStatement *update = forStatement->getUpdateAssign();
+                update->setRValue(visit(update->getRValue(), true));
+                visitBody(forStatement->getStatements());
+            }
+        }
+
+    public:
+        InvariantMotion(ASTContext &Context, OptimizerStats &Stats) : Context(Context), Stats(Stats) {}
+
+        llvm::SmallVector<Statement *> visitStatements(llvm::ArrayRef<Statement *> Stmts)
+        {
+            llvm::SmallVector<Statement *> Result;
+            for (Statement *Stmt : Stmts)
+            {
+                switch (Stmt->getKind())
+                {
+                case Statement::StatementType::If:
+                {
+                    IfStatement *ifStatement = (IfStatement *)Stmt;
+                    ifStatement->setStatements(visitStatements(ifStatement->getStatements()));
+                    for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                        elseIf->setStatements(visitStatements(elseIf->getStatements()));
+                    if (ifStatement->HasElse())
+                        ifStatement->getElseStatement()->setStatements(visitStatements(ifStatement->getElseStatement()->getStatements()));
+                    break;
+                }
+                case Statement::StatementType::While:
+                    visitLoop(Stmt, Result);
+                    ((WhileStatement *)Stmt)->setStatements(visitStatements(((WhileStatement *)Stmt)->getStatements()));
+                    break;
+                case Statement::StatementType::For:
+                    visitLoop(Stmt, Result);
+                    ((ForStatement *)Stmt)->setStatements(visitStatements(((ForStatement *)Stmt)->getStatements()));
+                    break;
+                default:
+                    break;
+                }
+                Result.push_back(Stmt);
+            }
+            return Result;
+        }
+    };
+
+    void addUses(Expression *Expr, llvm::BitVector &Live)
+    {
+        if (Expr->isVariable())
+            Live.set(Expr->getSymbol());
+        else if (Expr->isBinaryOp())
+        {
+            addUses(((BinaryOp *)Expr)->getLeft(), Live);
+            addUses(((BinaryOp *)Expr)->getRight(), Live);
+        }
+        else if (Expr->isBooleanOp())
+        {
+            addUses(((BooleanOp *)Expr)->getLeft(), Live);
+            addUses(((BooleanOp *)Expr)->getRight(), Live);
+        }
+    }
+
+    // true if running Stmts can do nothing but write variables
+    bool onlyStores(llvm::ArrayRef<Statement *> Stmts)
+    {
+        for (Statement *Stmt : Stmts)
+        {
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::Declaration:
+            {
+                Expression *Value = ((DecStatement *)Stmt)->getRValue();
+                if (Value && mayTrap(Value))
+                    return false;
+                break;
+            }
+            case Statement::StatementType::Assignment:
+                if (mayTrap(((AssignStatement *)Stmt)->getRValue()))
+                    return false;
+                break;
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                if (mayTrap(ifStatement->getCondition()) || !onlyStores(ifStatement->getStatements()))
+                    return false;
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    if (mayTrap(elseIf->getCondition()) || !onlyStores(elseIf->getStatements()))
+                        return false;
+                if (ifStatement->HasElse() && !onlyStores(ifStatement->getElseStatement()->getStatements()))
+                    return false;
+                break;
+            }
+            default:
+                // prints, and loops that may not terminate
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // true if a counted loop stops: its trip count is known or it steps by
+    // one towards a strict bound, which it cannot jump over
+    bool terminates(CountedLoop &Loop)
+    {
+        int64_t Trips;
+        if (!checkDirection(Loop, Trips))
+            return false;
+        bool Strict = Loop.Op == BooleanOp::Less || Loop.Op == BooleanOp::Greater;
+        return Trips >= 0 || (Strict && (Loop.Step == 1 || Loop.Step == -1));
+    }
+
+    // Dead code elimination driven by liveness. A variable is live where its
+    // value can still reach a print or a condition. Walking each block
+    // backwards, writes to variables that are not live are deleted unless
+    // they can trap, and so are loops that only write such variables and are
+    // known to terminate. Loop bodies are iterated to a fixed point first.
+    class DeadCodeElimination
+    {
+        OptimizerStats &Stats;
+        unsigned NumSymbols;
+        bool Changed = false;
+
+        bool isDead(Expression *Target, Expression *Value, const llvm::BitVector &Live)
+        {
+            return !Live.test(Target->getSymbol()) && (!Value || !mayTrap(Value));
+        }
+
+        // true if the loop writes a variable that is live after it
+        bool writesLive(Statement *Loop, const llvm::BitVector &Live)
+        {
+            std::vector<char> Assigned(NumSymbols);
+            collectAssigned(Loop, Assigned);
+            for (unsigned Var : Live.set_bits())
+                if (Assigned[Var])
+                    return true;
+            return false;
+        }
+
+        // live variables at the condition of a loop, Out being the ones live after it
+        llvm::BitVector loopHead(Expression *Condition, llvm::ArrayRef<Statement *> Body, AssignStatement *Update, const llvm::BitVector &Out)
+        {
+            llvm::BitVector Head = Out;
+            addUses(Condition, Head);
+            while (true)
+            {
+                llvm::BitVector In = Head;
+                if (Update)
+                {
+                    In.reset(Update->getLValue()->getSymbol());
+                    addUses(Update->getRValue(), In);
+                }
+                visitStatements(Body, In, nullptr);
+                In |= Out;
+                addUses(Condition, In);
+                if (In == Head)
+                    return Head;
+                Head = std::move(In);
+            }
+        }
+
+        // Updates Live from after Stmt to before it. With Remove set, dead
+        // parts of Stmt are deleted and false is returned when all of it is.
+        bool visit(Statement *Stmt, llvm::ArrayRef<Statement *> Before, llvm::BitVector &Live, bool Remove)
+        {
+            switch (Stmt->getKind())
+            {
+            case Statement::StatementType::Declaration:
+            {
+                DecStatement *declaration = (DecStatement *)Stmt;
+                Expression *Value = declaration->getRValue();
+                if (Value && isDead(declaration->getLValue(), Value, Live))
+                {
+                    // the variable still exists, but starts out as zero
+                    if (Remove)
+                    {
+                        declaration->setRValue(nullptr);
+                        ++Stats.DeadStores;
+                        Changed = true;
+                    }
+                    Value = nullptr;
+                }
+                Live.reset(declaration->getLValue()->getSymbol());
+                if (Value)
+                    addUses(Value, Live);
+                return true;
+            }
+            case Statement::StatementType::Assignment:
+            {
+                AssignStatement *assignment = (AssignStatement *)Stmt;
+                if (isDead(assignment->getLValue(), assignment->getRValue(), Live))
+                {
+                    if (!Remove)
+                        return true;
+                    ++Stats.DeadStores;
+                    Changed = true;
+                    return false;
+                }
+                Live.reset(assignment->getLValue()->getSymbol());
+                addUses(assignment->getRValue(), Live);
+                return true;
+            }
+            case Statement::StatementType::Print:
+                addUses(((PrintStatement *)Stmt)->getExpr(), Live);
+                return true;
+            case Statement::StatementType::If:
+            {
+                IfStatement *ifStatement = (IfStatement *)Stmt;
+                llvm::BitVector Out = Live;
+                bool Empty = true;
+                auto visitBranch = [&](llvm::ArrayRef<Statement *> Body) -> llvm::SmallVector<Statement *>
+                {
+                    llvm::BitVector In = Out;
+                    llvm::SmallVector<Statement *> Kept;
+                    visitStatements(Body, In, Remove ? &Kept : nullptr);
+                    Live |= In;
+                    Empty = Empty && (Remove ? Kept.empty() : Body.empty());
+                    return Kept;
+                };
+                llvm::SmallVector<Statement *> Then = visitBranch(ifStatement->getStatements());
+                if (Remove)
+                    ifStatement->setStatements(std::move(Then));
+                bool Traps = mayTrap(ifStatement->getCondition());
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                {
+                    llvm::SmallVector<Statement *> Kept = visitBranch(elseIf->getStatements());
+                    if (Remove)
+                        elseIf->setStatements(std::move(Kept));
+                    Traps = Traps || mayTrap(elseIf->getCondition());
+                }
+                if (ifStatement->HasElse())
+                {
+                    llvm::SmallVector<Statement *> Kept = visitBranch(ifStatement->getElseStatement()->getStatements());
+                    if (Remove)
+                        ifStatement->getElseStatement()->setStatements(std::move(Kept));
+                }
+                if (Remove && Empty && !Traps)
+                {
+                    Live = std::move(Out);
+                    ++Stats.DeadBranches;
+                    Changed = true;
+                    return false;
+                }
+                addUses(ifStatement->getCondition(), Live);
+                for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    addUses(elseIf->getCondition(), Live);
+                return true;
+            }
+            case Statement::StatementType::While:
+            {
+                WhileStatement *whileStatement = (WhileStatement *)Stmt;
+                llvm::BitVector Head = loopHead(whileStatement->getCondition(), whileStatement->getStatements(), nullptr, Live);
+                if (Remove)
+                {
+                    llvm::BitVector In = Head;
+                    llvm::SmallVector<Statement *> Kept;
+                    visitStatements(whileStatement->getStatements(), In, &Kept);
+                    whileStatement->setStatements(std::move(Kept));
+
+                    CountedLoop Loop;
+                    size_t UpdateIndex;
+                    if (!writesLive(Stmt, Live) && !mayTrap(whileStatement->getCondition()) &&
+                        onlyStores(whileStatement->getStatements()) &&
+                        matchWhileLoop(whileStatement, Before, Loop, UpdateIndex) && terminates(Loop))
+                    {
+                        ++Stats.DeadLoops;
+                        Changed = true;
+                        return false;
+                    }
+                }
+                Live = std::move(Head);
+                return true;
+            }
+            case Statement::StatementType::For:
+            {
+                ForStatement *forStatement = (ForStatement *)Stmt;
+                AssignStatement *initial = forStatement->getInitialAssign();
+                llvm::BitVector Head = loopHead(forStatement->getCondition(), forStatement->getStatements(), forStatement->getUpdateAssign(), Live);
+                if (Remove)
+                {
+                    llvm::BitVector In = Head;
+                    In.reset(forStatement->getUpdateAssign()->getLValue()->getSymbol());
+                    addUses(forStatement->getUpdateAssign()->getRValue(), In);
+                    llvm::SmallVector<Statement *> Kept;
+                    visitStatements(forStatement->getStatements(), In, &Kept);
+                    forStatement->setStatements(std::move(Kept));
+
+                    CountedLoop Loop;
+                    if (!writesLive(Stmt, Live) && !mayTrap(initial->getRValue()) && !mayTrap(forStatement->getCondition()) &&
+                        onlyStores(forStatement->getStatements()) && matchForLoop(forStatement, Loop) && terminates(Loop))
+                    {
+                        ++Stats.DeadLoops;
+                        Changed = true;
+                        return false;
+                    }
+                }
+                Live = std::move(Head);
+                Live.reset(initial->getLValue()->getSymbol());
+                addUses(initial->getRValue(), Live);
+                return true;
+            }
+            default:
+                return true;
+            }
+        }
+
+        // Kept receives the statements that survive, or is null to only compute liveness
+        void visitStatements(llvm::ArrayRef<Statement *> Stmts, llvm::BitVector &Live, llvm::SmallVectorImpl<Statement *> *Kept)
+        {
+            size_t First = Kept ? Kept->size() : 0;
+            for (size_t I = Stmts.size(); I-- != 0;)
+                if (visit(Stmts[I], Stmts.take_front(I), Live, Kept) && Kept)
+                    Kept->push_back(Stmts[I]);
+            if (Kept)
+                std::reverse(Kept->begin() + First, Kept->end());
+        }
+
+        void collectReferenced(Expression *Expr, std::vector<char> &Referenced)
+        {
+            if (Expr->isVariable())
+                Referenced[Expr->getSymbol()] = true;
+            else if (Expr->isBinaryOp())
+            {
+                collectReferenced(((BinaryOp *)Expr)->getLeft(), Referenced);
+                collectReferenced(((BinaryOp *)Expr)->getRight(), Referenced);
+            }
+            else if (Expr->isBooleanOp())
+            {
+                collectReferenced(((BooleanOp *)Expr)->getLeft(), Referenced);
+                collectReferenced(((BooleanOp *)Expr)->getRight(), Referenced);
+            }
+        }
+
+        // marks the variables Stmts mention anywhere but in their own declaration
+        void collectReferenced(llvm::ArrayRef<Statement *> Stmts, std::vector<char> &Referenced)
+        {
+            for (Statement *Stmt : Stmts)
+            {
+                switch (Stmt->getKind())
+                {
+                case Statement::StatementType::Declaration:
+                    if (Expression *Value = ((DecStatement *)Stmt)->getRValue())
+                        collectReferenced(Value, Referenced);
+                    break;
+                case Statement::StatementType::Assignment:
+                    collectReferenced(((AssignStatement *)Stmt)->getLValue(), Referenced);
+                    collectReferenced(((AssignStatement *)Stmt)->getRValue(), Referenced);
+                    break;
+                case Statement::StatementType::Print:
+                    collectReferenced(((PrintStatement *)Stmt)->getExpr(), Referenced);
+                    break;
+                case Statement::StatementType::If:
+                {
+                    IfStatement *ifStatement = (IfStatement *)Stmt;
+                    collectReferenced(ifStatement->getCondition(), Referenced);
+                    collectReferenced(ifStatement->getStatements(), Referenced);
+                    for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                    {
+                        collectReferenced(elseIf->getCondition(), Referenced);
+                        collectReferenced(elseIf->getStatements(), Referenced);
+                    }
+                    if (ifStatement->HasElse())
+                        collectReferenced(ifStatement->getElseStatement()->getStatements(), Referenced);
+                    break;
+                }
+                case Statement::StatementType::While:
+                    collectReferenced(((WhileStatement *)Stmt)->getCondition(), Referenced);
+                    collectReferenced(((WhileStatement *)Stmt)->getStatements(), Referenced);
+                    break;
+                case Statement::StatementType::For:
+                {
+                    ForStatement *forStatement = (ForStatement *)Stmt;
+                    collectReferenced(forStatement->getInitialAssign()->getLValue(), Referenced);
+                    collectReferenced(forStatement->getInitialAssign()->getRValue(), Referenced);
+                    collectReferenced(forStatement->getCondition(), Referenced);
+                    collectReferenced(forStatement->getUpdateAssign()->getRValue(), Referenced);
+                    collectReferenced(forStatement->getStatements(), Referenced);
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+
+        // drops declarations of variables nothing else mentions
+        llvm::SmallVector<Statement *> removeDeclarations(llvm::ArrayRef<Statement *> Stmts, const std::vector<char> &Referenced)
+        {
+            llvm::SmallVector<Statement *> Result;
+            for (Statement *Stmt : Stmts)
+            {
+                switch (Stmt->getKind())
+                {
+                case Statement::StatementType::Declaration:
+                {
+                    DecStatement *declaration = (DecStatement *)Stmt;
+                    if (!Referenced[declaration->getLValue()->getSymbol()] &&
+                        (!declaration->getRValue() || !mayTrap(declaration->getRValue())))
+                    {
+                        ++Stats.DeadDeclarations;
+                        Changed = true;
+                        continue;
+                    }
+                    break;
+                }
+                case Statement::StatementType::If:
+                {
+                    IfStatement *ifStatement = (IfStatement *)Stmt;
+                    ifStatement->setStatements(removeDeclarations(ifStatement->getStatements(), Referenced));
+                    for (ElseIfStatement *elseIf : ifStatement->getElseIfStatements())
+                        elseIf->setStatements(removeDeclarations(elseIf->getStatements(), Referenced));
+                    if (ifStatement->HasElse())
+                        ifStatement->getElseStatement()->setStatements(
+                            removeDeclarations(ifStatement->getElseStatement()->getStatements(), Referenced));
+                    break;
+                }
+                case Statement::StatementType::While:
+                    ((WhileStatement *)Stmt)->setStatements(removeDeclarations(((WhileStatement *)Stmt)->getStatements(), Referenced));
+                    break;
+                case Statement::StatementType::For:
+                    ((ForStatement *)Stmt)->setStatements(removeDeclarations(((ForStatement *)Stmt)->getStatements(), Referenced));
+                    break;
+                default:
+                    break;
+                }
+                Result.push_back(Stmt);
+            }
+            return Result;
+        }
+
+    public:
+        DeadCodeElimination(ASTContext &Context, OptimizerStats &Stats) : Stats(Stats), NumSymbols(Context.getSymbols().size()) {}
+
+        // repeats until nothing changes, as each removal can make more code dead
+        void run(Base *Tree)
+        {
+            do
+            {
+                Changed = false;
+                llvm::BitVector Live(NumSymbols);
+                llvm::SmallVector<Statement *> Kept;
+                visitStatements(Tree->getStatements(), Live, &Kept);
+                std::vector<char> Referenced(NumSymbols);
+                collectReferenced(Kept, Referenced);
+                Tree->setStatements(removeDeclarations(Kept, Referenced));
+            } while (Changed);
+        }
+    };
+}
+
+unsigned countNodes(llvm::ArrayRef<Statement *> Stmts)
+{
+    unsigned Count = 0;
+    for (Statement *Stmt : Stmts)
+        Count += countNodes(Stmt);
+    return Count;
+}
+
+void propagateConstants(ASTContext &Context, Base *Tree, OptimizerStats &Stats)
+{
+    ConstantPropagation Propagation(Context, Stats);
+    Propagation.visitStatements(Tree->getStatements());
+}
+
+void hoistInvariants(ASTContext &Context, Base *Tree, OptimizerStats &Stats)
+{
+    InvariantMotion Motion(Context, Stats);
+    Tree->setStatements(Motion.visitStatements(Tree->getStatements()));
+}
+
+void removeDeadCode(ASTContext &Context, Base *Tree, OptimizerStats &Stats)
+{
+    DeadCodeElimination Elimination(Context, Stats);
+    Elimination.run(Tree);
+}
+
+void optimizeAST(ASTContext &Context, AST *Tree, const OptimizerOptions &Options, OptimizerStats &Stats)
+{
+    Base *Program = (Base *)Tree;
+    Stats.NodesBefore = countNodes(Program->getStatements());
+    Stats.AllocatedBefore = Context.getNumNodes();
+
+    propagateConstants(Context, Program, Stats);
+    reduceLoops(Context, Program, Stats);
+    if (Options.Hoist)
+        hoistInvariants(Context, Program, Stats);
+    if (Options.Unroll)
+        Program->setStatements(unrollLoops(Context, Program->getStatements(), Options, Stats));
+    // clean up the offsets the unroller substitutes for the iterator and the literal sums
+    if (Options.Unroll || Stats.ReducedLoops)
+        propagateConstants(Context, Program, Stats);
+    if (Options.RemoveDeadCode)
+        removeDeadCode(Context, Program, Stats);
+
+    Stats.NodesAfter = countNodes(Program->getStatements());
+    Stats.AllocatedAfter = Context.getNumNodes();
+}
+
+void OptimizerStats::print(llvm::raw_ostream &OS) const
+{
+    OS << "AST nodes: " << NodesBefore << " -> " << NodesAfter;
+    if (NodesBefore >= NodesAfter)
+        OS << " (" << NodesBefore - NodesAfter << " removed)";
+    OS << "\nallocated AST nodes: " << AllocatedBefore << " -> " << AllocatedAfter;
+    OS << "\nfolded expressions: " << FoldedExpressions
+       << "\npropagated constants: " << PropagatedConstants
+       << "\nclosed-form loops: " << ReducedLoops
+       << "\nhoisted invariant expressions: " << HoistedExpressions
+       << "\nunrolled loops: " << UnrolledLoops
+       << "\nunroller expression nodes: " << UnrollNodesCreated << " created, " << UnrollNodesShared << " shared"
+       << "\ndead stores: " << DeadStores
+       << "\ndead declarations: " << DeadDeclarations
+       << "\ndead loops: " << DeadLoops
+       << "\nempty ifs: " << DeadBranches << "\n";
+}
@@ -1,13 +1,90 @@
 #ifndef OPTIMIZER_H
 #define OPTIMIZER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
 #include "AST.h"
 
-Expression *updateExpression(Expression *expression, llvm::StringRef iterator, int increase);
-Statement *updateStatement(Statement *statement, llvm::StringRef iterator, int increase);
-llvm::SmallVector<Statement*> completeUnroll(ForStatement *forStatement, int k);
-llvm::SmallVector<Statement*> completeUnroll(WhileStatement *whileStatement, int k);
+// Counters reported by -opt-stats
+struct OptimizerStats
+{
+    unsigned NodesBefore = 0;         // AST nodes reachable before the pipeline
+    unsigned NodesAfter = 0;          // and after it
+    unsigned AllocatedBefore = 0;     // nodes allocated in the ASTContext, shared ones counted once
+    unsigned AllocatedAfter = 0;
+    unsigned FoldedExpressions = 0;   // operators replaced by a literal or one of their operands
+    unsigned PropagatedConstants = 0; // variable reads replaced by a known value
+    unsigned ReducedLoops = 0;        // loops replaced by the closed form of their sums
+    unsigned HoistedExpressions = 0;  // loop-invariant subtrees moved in front of their loop
+    unsigned UnrolledLoops = 0;
+    unsigned UnrollNodesCreated = 0;  // expression nodes the unroller allocated for its copies
+    unsigned UnrollNodesShared = 0;   // and the ones it reused instead of copying
+    unsigned DeadStores = 0;          // assignments and initializers whose value is never read
+    unsigned DeadDeclarations = 0;    // declarations of variables nothing uses
+    unsigned DeadLoops = 0;           // terminating loops that only write dead variables
+    unsigned DeadBranches = 0;        // ifs left without statements
 
+    void print(llvm::raw_ostream &OS) const;
+};
 
-#endif
\ No newline at end of file
+struct OptimizerOptions
+{
+    bool Hoist = false;
+    bool RemoveDeadCode = false;
+    bool Unroll = false;
+    int UnrollFactor = 0; // 0 lets the cost model pick a factor per loop
+    llvm::raw_ostream *UnrollReport = nullptr; // receives the factor chosen for each loop
+};
+
+// AST passes run between semantic analysis and code generation
+void optimizeAST(ASTContext &Context, AST *Tree, const OptimizerOptions &Options, OptimizerStats &Stats);
+
+// folds literal subexpressions and propagates known variable values
+void propagateConstants(ASTContext &Context, Base *Tree, OptimizerStats &Stats);
+
+// replaces counted loops that only accumulate polynomials of their iterator by sum formulas
+void reduceLoops(ASTContext &Context, Base *Tree, OptimizerStats &Stats);
+
+// moves arithmetic that no statement of a loop depends on in front of the loop
+void hoistInvariants(ASTContext &Context, Base *Tree, OptimizerStats &Stats);
+
+// deletes writes no print or condition can observe, and then unused declarations
+void removeDeadCode(ASTContext &Context, Base *Tree, OptimizerStats &Stats);
+
+// Evaluates Left Op Right like the generated code does, 32-bit wrapping.
+// Returns false for operations that trap or are undefined at runtime.
+bool evaluateBinaryOp(BinaryOp::Operator Op, int32_t Left, int32_t Right, int32_t &Result);
+bool evaluateComparison(BooleanOp::Operator Op, int32_t Left, int32_t Right);
+
+// number of statement and expression nodes reachable from Stmts
+unsigned countNodes(llvm::ArrayRef<Statement *> Stmts);
+
+// Memo of updateExpression for a single iterator, keyed by (subtree, increase)
+struct UpdateCache
+{
+    llvm::DenseMap<std::pair<Expression *, int>, Expression *> Updated;
+    unsigned Created = 0;
+    unsigned Shared = 0;
+};
+
+// Copies of expression and statement trees in which every read of iterator
+// is iterator + increase. Statements are always copied, expressions that do
+// not read the iterator are shared with the original.
+Expression *updateExpression(ASTContext &Context, Expression *expression, unsigned iterator, int increase, UpdateCache &cache);
+Statement *updateStatement(ASTContext &Context, Statement *statement, unsigned iterator, int increase, UpdateCache &cache);
+llvm::SmallVector<Statement*> updateStatements(ASTContext &Context, llvm::ArrayRef<Statement*> statements, unsigned iterator, int increase, UpdateCache &cache);
+
+// Unroll a counted loop by Options.UnrollFactor or the factor the cost model
+// picks, completely when the trip count is at most that, appending the
+// replacement statements to Result. Loops whose iterator, step or direction
+// cannot be proven are left alone and false is returned. Before are the
+// statements preceding a while loop in its block, searched for the value its
+// iterator starts from.
+bool unrollLoop(ASTContext &Context, ForStatement *forStatement, const OptimizerOptions &Options,
+                llvm::SmallVectorImpl<Statement*> &Result, OptimizerStats &Stats);
+bool unrollLoop(ASTContext &Context, WhileStatement *whileStatement, llvm::ArrayRef<Statement*> Before,
+                const OptimizerOptions &Options, llvm::SmallVectorImpl<Statement*> &Result, OptimizerStats &Stats);
+
+
+#endif
@@ -55,12 +55,11 @@ Base *Parser::parse()
         }
         case Token::identifier:
         {
-            llvm::StringRef name = Tok.getText();
             Token current = Tok;
             advance();
             if (!Tok.isOneOf(Token::plus_plus, Token::minus_minus))
             {
-                AssignStatement *assign = parseAssign(name);
+                AssignStatement *assign = parseAssign(current);
                 statements.push_back(assign);
             }
             else
@@ -84,7 +83,7 @@ Base *Parser::parse()
             {
                 Error::VariableExpected();
             }
-            Expression *variable_to_be_printed = new Expression(Tok.getText());
+            Expression *variable_to_be_printed = createIdentifier(Tok);
             advance();
             if (!Tok.is(Token::r_paren))
             {
@@ -92,7 +91,7 @@ Base *Parser::parse()
             }
             advance();
             Parser::check_for_semicolon();
-            PrintStatement *print_statement = new PrintStatement(variable_to_be_printed);
+            PrintStatement *print_statement = Context.create<PrintStatement>(variable_to_be_printed);
             statements.push_back(print_statement);
             break;
         }
@@ -127,7 +126,7 @@ Base *Parser::parse()
         }
         }
     }
-    return new Base(statements);
+    return Context.create<Base>(std::move(statements));
 }
 
 void Parser::check_for_semicolon()
@@ -147,9 +146,9 @@ AssignStatement *Parser::parseUnaryExpression(Token &token)
         advance();
         if (token.is(Token::identifier))
         {
-            Expression *tok = new Expression(token.getText());
-            Expression *one = new Expression(1);
-            res = new AssignStatement(tok, new BinaryOp(BinaryOp::Plus, tok, one));
+            Expression *tok = createIdentifier(token);
+            Expression *one = Context.create<Expression>(1);
+            res = Context.create<AssignStatement>(tok, Context.create<BinaryOp>(BinaryOp::Plus, tok, one));
         }
         else
         {
@@ -161,9 +160,9 @@ AssignStatement *Parser::parseUnaryExpression(Token &token)
         advance();
         if (token.is(Token::identifier))
         {
-            Expression *tok = new Expression(token.getText());
-            Expression *one = new Expression(1);
-            res = new AssignStatement(tok, new BinaryOp(BinaryOp::Minus, tok, one));
+            Expression *tok = createIdentifier(token);
+            Expression *one = Context.create<Expression>(1);
+            res = Context.create<AssignStatement>(tok, Context.create<BinaryOp>(BinaryOp::Minus, tok, one));
         }
         else
         {
@@ -178,11 +177,11 @@ llvm::SmallVector<DecStatement *> Parser::parseDefine(Token::TokenKind token_kin
     llvm::SmallVector<DecStatement *> states;
     while (!Tok.is(Token::semi_colon))
     {
-        llvm::StringRef name;
+        Token name;
         Expression *value = nullptr;
         if (Tok.is(Token::identifier))
         {
-            name = Tok.getText();
+            name = Tok;
             advance();
         }
         else
@@ -208,9 +207,9 @@ llvm::SmallVector<DecStatement *> Parser::parseDefine(Token::TokenKind token_kin
         }
         DecStatement *state;
         if(token_kind == Token::KW_int){
-            state = new DecStatement(new Expression(name), value, DecStatement::DecStatementType::Number);
+            state = Context.create<DecStatement>(createIdentifier(name), value, DecStatement::DecStatementType::Number);
         }else{
-            state = new DecStatement(new Expression(name), value, DecStatement::DecStatementType::Boolean);
+            state = Context.create<DecStatement>(createIdentifier(name), value, DecStatement::DecStatementType::Boolean);
         }
         
         states.push_back(state);
@@ -239,7 +238,7 @@ Expression *Parser::parseExpression()
         }
         advance();
         Expression *Right = parseLogicalComparison();
-        left = new BooleanOp(Op, left, Right);
+        left = Context.create<BooleanOp>(Op, left, Right);
     }
     return left;
 }
@@ -275,7 +274,7 @@ Expression *Parser::parseLogicalComparison()
         }
         advance();
         Expression *Right = parseIntExpression();
-        left = new BooleanOp(Op, left, Right);
+        left = Context.create<BooleanOp>(Op, left, Right);
     }
     return left;
 }
@@ -289,7 +288,7 @@ Expression *Parser::parseIntExpression()
             Tok.is(Token::plus) ? BinaryOp::Plus : BinaryOp::Minus;
         advance();
         Expression *Right = parseTerm();
-        Left = new BinaryOp(Op, Left, Right);
+        Left = Context.create<BinaryOp>(Op, Left, Right);
     }
     return Left;
 }
@@ -304,7 +303,7 @@ Expression *Parser::parseTerm()
                                                                        : BinaryOp::Mod;
         advance();
         Expression *Right = parseSign();
-        Left = new BinaryOp(Op, Left, Right);
+        Left = Context.create<BinaryOp>(Op, Left, Right);
     }
     return Left;
 }
@@ -314,7 +313,7 @@ Expression *Parser::parseSign()
     if (Tok.is(Token::minus))
     {
         advance();
-        return new BinaryOp(BinaryOp::Mul, new Expression(-1), parsePower());
+        return Context.create<BinaryOp>(BinaryOp::Mul, Context.create<Expression>(-1), parsePower());
     }
     else if (Tok.is(Token::plus))
     {
@@ -333,7 +332,7 @@ Expression *Parser::parsePower()
             BinaryOp::Pow;
         advance();
         Expression *Right = parseFactor();
-        Left = new BinaryOp(Op, Left, Right);
+        Left = Context.create<BinaryOp>(Op, Left, Right);
     }
     return Left;
 }
@@ -347,13 +346,13 @@ Expression *Parser::parseFactor()
     {
         int number;
         Tok.getText().getAsInteger(10, number);
-        Res = new Expression(number);
+        Res = Context.create<Expression>(number);
         advance();
         break;
     }
     case Token::identifier:
     {
-        Res = new Expression(Tok.getText());
+        Res = createIdentifier(Tok);
         advance();
         break;
     }
@@ -366,13 +365,13 @@ Expression *Parser::parseFactor()
     }
     case Token::KW_true:
     {
-        Res = new Expression(true);
+        Res = Context.create<Expression>(true);
         advance();
         break;
     }
     case Token::KW_false:
     {
-        Res = new Expression(false);
+        Res = Context.create<Expression>(false);
         advance();
         break;
     }
@@ -384,8 +383,9 @@ Expression *Parser::parseFactor()
     return Res;
 }
 
-AssignStatement *Parser::parseAssign(llvm::StringRef name)
+AssignStatement *Parser::parseAssign(Token &name)
 {
+    Expression *target = createIdentifier(name);
     Expression *value = nullptr;
     if (Tok.is(Token::equal))
     {
@@ -397,24 +397,24 @@ AssignStatement *Parser::parseAssign(llvm::StringRef name)
         advance();
         value = parseExpression();
         if(current_op.is(Token::plus_equal)){
-            value = new BinaryOp(BinaryOp::Plus, new Expression(name), value);
+            value = Context.create<BinaryOp>(BinaryOp::Plus, target, value);
         }else if(current_op.is(Token::minus_equal)){
-            value = new BinaryOp(BinaryOp::Minus, new Expression(name), value);
+            value = Context.create<BinaryOp>(BinaryOp::Minus, target, value);
         }else if(current_op.is(Token::star_equal)){
-            value = new BinaryOp(BinaryOp::Mul, new Expression(name), value);
+            value = Context.create<BinaryOp>(BinaryOp::Mul, target, value);
         }else if(current_op.is(Token::slash_equal)){
-            value = new BinaryOp(BinaryOp::Div, new Expression(name), value);
+            value = Context.create<BinaryOp>(BinaryOp::Div, target, value);
         }else if(current_op.is(Token::mod_equal)){
-            value = new BinaryOp(BinaryOp::Mod, new Expression(name), value);
+            value = Context.create<BinaryOp>(BinaryOp::Mod, target, value);
         }
     }else{
         Error::EqualExpected();
     }
     
-    return new AssignStatement(new Expression(name), value);
+    return Context.create<AssignStatement>(target, value);
 }
 
-Base *Parser::parseStatement()
+llvm::SmallVector<Statement *> Parser::parseStatement()
 {
     llvm::SmallVector<Statement *> statements;
     bool isComment = false;
@@ -434,12 +434,11 @@ Base *Parser::parseStatement()
         {
         case Token::identifier:
         {
-            llvm::StringRef name = Tok.getText();
             Token current = Tok;
             advance();
             if (!Tok.isOneOf(Token::plus_plus, Token::minus_minus))
             {
-                AssignStatement *assign = parseAssign(name);
+                AssignStatement *assign = parseAssign(current);
                 statements.push_back(assign);
             }
             else
@@ -463,7 +462,7 @@ Base *Parser::parseStatement()
             {
                 Error::VariableExpected();
             }
-            Expression *tok = new Expression(Tok.getText());
+            Expression *tok = createIdentifier(Tok);
             advance();
             if (!Tok.is(Token::r_paren))
             {
@@ -471,7 +470,7 @@ Base *Parser::parseStatement()
             }
             advance();
             Parser::check_for_semicolon();
-            PrintStatement *print_statement = new PrintStatement(tok);
+            PrintStatement *print_statement = Context.create<PrintStatement>(tok);
             statements.push_back(print_statement);
             break;
         }
@@ -505,7 +504,7 @@ Base *Parser::parseStatement()
         }
         }
     }
-    return new Base(statements);
+    return statements;
 }
 
 IfStatement *Parser::parseIf()
@@ -530,7 +529,7 @@ IfStatement *Parser::parseIf()
         Error::LeftBraceExpected();
     }
     advance();
-    Base *allIfStatements = parseStatement();
+    llvm::SmallVector<Statement *> allIfStatements = parseStatement();
     if (!Tok.is(Token::r_brace))
     {
         Error::RightBraceExpected();
@@ -554,13 +553,13 @@ IfStatement *Parser::parseIf()
         else if (Tok.is(Token::l_brace))
         {
             advance();
-            Base *allElseStatements = parseStatement();
+            llvm::SmallVector<Statement *> allElseStatements = parseStatement();
             if (!Tok.is(Token::r_brace))
             {
                 Error::RightBraceExpected();
             }
             advance();
-            elseStatement = new ElseStatement(allElseStatements->getStatements(), Statement::StatementType::Else);
+            elseStatement = Context.create<ElseStatement>(std::move(allElseStatements), Statement::StatementType::Else);
             hasElse = true;
             break;
         }
@@ -570,7 +569,7 @@ IfStatement *Parser::parseIf()
         }
     }
 
-    return new IfStatement(condition, allIfStatements->getStatements(), elseIfStatements, elseStatement, hasElseIf, hasElse, Statement::StatementType::If);
+    return Context.create<IfStatement>(condition, std::move(allIfStatements), std::move(elseIfStatements), elseStatement, hasElseIf, hasElse, Statement::StatementType::If);
 }
 
 ElseIfStatement *Parser::parseElseIf()
@@ -595,14 +594,14 @@ ElseIfStatement *Parser::parseElseIf()
         Error::LeftBraceExpected();
     }
     advance();
-    Base *allIfStatements = parseStatement();
+    llvm::SmallVector<Statement *> allIfStatements = parseStatement();
     if (!Tok.is(Token::r_brace))
     {
         Error::RightBraceExpected();
     }
     advance();
 
-    return new ElseIfStatement(condition, allIfStatements->getStatements(), Statement::StatementType::ElseIf);
+    return Context.create<ElseIfStatement>(condition, std::move(allIfStatements), Statement::StatementType::ElseIf);
 }
 
 WhileStatement *Parser::parseWhile()
@@ -625,10 +624,10 @@ WhileStatement *Parser::parseWhile()
     if (Tok.is(Token::l_brace))
     {
         advance();
-        Base *allWhileStatements = parseStatement();
+        llvm::SmallVector<Statement *> allWhileStatements = parseStatement();
         if(!consume(Token::r_brace))
         {
-            return new WhileStatement(condition, allWhileStatements->getStatements(), Statement::StatementType::While);
+            return Context.create<WhileStatement>(condition, std::move(allWhileStatements), Statement::StatementType::While);
         }
         else
 		{
@@ -655,7 +654,7 @@ ForStatement *Parser::parseFor()
         Error::VariableExpected();
 
     }
-    llvm::StringRef name = Tok.getText();
+    Token name = Tok;
     advance();                                  //= 0;i<10;i++)
     AssignStatement *assign = parseAssign(name);
     //Expression *value = nullptr;
@@ -663,7 +662,7 @@ ForStatement *Parser::parseFor()
     {
         advance();                              //0;i<10;i++)
         value = parseExpression();
-        AssignStatement *assign = new AssignStatement(new Expression(name), value);
+        AssignStatement *assign = Context.create<AssignStatement>(createIdentifier(name), value);
     }*/
     //advance();
     check_for_semicolon();
@@ -675,13 +674,12 @@ ForStatement *Parser::parseFor()
         Error::VariableExpected();
 
     }
-    llvm::StringRef name_up = Tok.getText();
     Token current = Tok;
     AssignStatement *assign_up = nullptr;
     advance();
     if (!Tok.isOneOf(Token::plus_plus, Token::minus_minus))
     {
-        assign_up = parseAssign(name_up);
+        assign_up = parseAssign(current);
     }
     else
     {
@@ -696,10 +694,10 @@ ForStatement *Parser::parseFor()
     if (Tok.is(Token::l_brace))
     {
         advance();
-        Base *allForStatements = parseStatement();
+        llvm::SmallVector<Statement *> allForStatements = parseStatement();
         if(!consume(Token::r_brace))
         {
-            return new ForStatement(condition, allForStatements->getStatements(),assign,assign_up, Statement::StatementType::For);
+            return Context.create<ForStatement>(condition, std::move(allForStatements),assign,assign_up, Statement::StatementType::For);
         }
         else
 		{
@@ -9,6 +9,7 @@ using namespace std;
 class Parser
 {
     Lexer &Lex;
+    ASTContext &Context;
     Token Tok;
     bool HasError;
 
@@ -20,6 +21,12 @@ class Parser
 
     void advance() { Lex.next(Tok); }
 
+    // identifier node for an identifier token, carrying its interned name
+    Expression *createIdentifier(const Token &Name)
+    {
+        return Context.create<Expression>(Name.getText(), Name.getSymbol());
+    }
+
     bool expect(Token::TokenKind Kind)
     {
         if (Tok.getKind() != Kind)
@@ -43,7 +50,7 @@ class Parser
     // one node can have multiple subnodes inside it
 public:
     Base *parse();
-    Base *parseStatement();
+    llvm::SmallVector<Statement *> parseStatement();
     IfStatement *parseIf();
     ElseIfStatement *parseElseIf();
     AssignStatement *parseUnaryExpression(Token &token);
@@ -56,13 +63,13 @@ public:
     Expression *parseFactor();
     ForStatement *parseFor();
     WhileStatement *parseWhile();
-    AssignStatement *parseAssign(llvm::StringRef name);
+    AssignStatement *parseAssign(Token &name);
     llvm::SmallVector<DecStatement *> parseDefine(Token::TokenKind token_kind);
     void check_for_semicolon();
 
 public:
     // initializes all members and retrieves the first token
-    Parser(Lexer &Lex) : Lex(Lex), HasError(false)
+    Parser(Lexer &Lex, ASTContext &Context) : Lex(Lex), Context(Context), HasError(false)
     {
         advance();
     }
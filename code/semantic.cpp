@@ -1,12 +1,14 @@
 #include "semantic.h"
-#include "llvm/ADT/StringMap.h"
+#include "flat_ast.h"
 #include "llvm/Support/raw_ostream.h"
+#include <vector>
 
 namespace
 {
-    class DeclCheck : public ASTVisitor
+    class DeclCheck
     {
-        llvm::StringMap<char> variableTypeMap;
+        const SymbolTable &Symbols;
+        std::vector<char> variableTypeMap; // indexed by symbol ID, 0 while undeclared
         bool HasError;
 
         enum ErrorType
@@ -42,271 +44,113 @@ namespace
         }
 
     public:
-        DeclCheck() : HasError(false) {}
+        DeclCheck(const SymbolTable &Symbols) : Symbols(Symbols), variableTypeMap(Symbols.size(), 0), HasError(false) {}
 
         bool hasError() { return HasError; }
 
-        virtual void visit(Base &Node) override
+        // Walks the flat tree once in source order. A declaration registers
+        // its name before its children are reached, so every identifier node
+        // met afterwards only has to be looked up.
+        void check(const FlatAST &Flat)
         {
-            for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+            for (uint32_t I = 0, E = Flat.size(); I != E; ++I)
             {
-                (*I)->accept(*this);
-            }
-        };
-
-        virtual void visit(PrintStatement &Node) override
-        {
-            Expression *declaration = (Expression *)Node.getExpr();
-            declaration->accept(*this);
-        };
-
-        virtual void visit(BinaryOp &Node) override
-        {
-            if (Node.getLeft())
-            {
-                Node.getLeft()->accept(*this);
-            }
-            else
-            {
-                HasError = true;
-            }
-            if (Node.getRight())
-            {
-                Node.getRight()->accept(*this);
-            }
-            else
-            {
-                HasError = true;
-            }
-
-            // Divide by zero check
-            if (Node.getOperator() == BinaryOp::Operator::Div)
-            {
-                Expression *right = (Expression *)Node.getRight();
-                if (right->isNumber() && right->getNumber() == 0)
+                switch (Flat.getKind(I))
                 {
-                    error(DivideByZero, ((Expression *)Node.getLeft())->getValue());
-                }
-            }
-        };
-
-        virtual void visit(Statement &Node) override
-        {
-            if (Node.getKind() == Statement::StatementType::Declaration)
-            {
-                DecStatement *declaration = (DecStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Assignment)
-            {
-                AssignStatement *declaration = (AssignStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::If)
-            {
-                IfStatement *declaration = (IfStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::ElseIf)
-            {
-                ElseIfStatement *declaration = (ElseIfStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Else)
-            {
-                ElseStatement *declaration = (ElseStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::Print)
-            {
-                PrintStatement *declaration = (PrintStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::While)
-            {
-                WhileStatement *declaration = (WhileStatement *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Statement::StatementType::For)
-            {
-                ForStatement *declaration = (ForStatement *)&Node;
-                declaration->accept(*this);
-            }
-            
-            
-        };
-
-        virtual void visit(BooleanOp &Node) override
-        {
-            if (Node.getLeft())
-            {
-                Node.getLeft()->accept(*this);
-            }
-            else
-            {
-                HasError = true;
-            }
-            if (Node.getRight())
-            {
-                Node.getRight()->accept(*this);
-            }
-            else
-            {
-                HasError = true;
-            }
-        };
-
-        virtual void visit(Expression &Node) override
-        {
-            if (Node.getKind() == Expression::ExpressionType::Identifier)
-            {
-                if (variableTypeMap.count(Node.getValue()) == 0)
+                case FlatAST::IdentifierNode:
+                    if (variableTypeMap[Flat.getSymbol(I)] == 0)
+                    {
+                        error(NotDefinedVariable, Symbols.getName(Flat.getSymbol(I)));
+                    }
+                    break;
+                case FlatAST::BinaryOpNode:
                 {
-                    error(NotDefinedVariable, Node.getValue());
+                    // Divide by zero check
+                    uint32_t Right = Flat.getNextSibling(I + 1);
+                    if (Flat.getOp(I) == BinaryOp::Operator::Div &&
+                        Flat.getKind(Right) == FlatAST::NumberNode && Flat.getValue(Right) == 0)
+                    {
+                        error(DivideByZero, "");
+                    }
+                    break;
+                }
+                case FlatAST::DeclNode:
+                    checkDeclaration(Flat, I);
+                    break;
+                case FlatAST::AssignNode:
+                    checkAssignment(Flat, I);
+                    break;
+                default:
+                    break;
                 }
             }
-            else if (Node.getKind() == Expression::ExpressionType::BinaryOpType)
-            {
-                BinaryOp *declaration = (BinaryOp *)&Node;
-                declaration->accept(*this);
-            }
-            else if (Node.getKind() == Expression::ExpressionType::BooleanOpType)
-            {
-                Node.getBooleanOp()->getLeft()->accept(*this);
-                Node.getBooleanOp()->getRight()->accept(*this);
-            }
-        };
+        }
 
-        virtual void visit(DecStatement &Node) override
+    private:
+        void checkDeclaration(const FlatAST &Flat, uint32_t Node)
         {
-            if (variableTypeMap.count(Node.getLValue()->getValue()) > 0)
+            uint32_t Name = Node + 1;
+            if (variableTypeMap[Flat.getSymbol(Name)] != 0)
             {
-                error(AlreadyDefinedVariable, Node.getLValue()->getValue());
+                error(AlreadyDefinedVariable, Symbols.getName(Flat.getSymbol(Name)));
             }
             // Add this new variable to variableTypeMap
-            if (Node.getDecType() == DecStatement::DecStatementType::Boolean)
+            if (Flat.getOp(Node) == DecStatement::DecStatementType::Boolean)
             {
-                variableTypeMap[Node.getLValue()->getValue()] = 'b';
+                variableTypeMap[Flat.getSymbol(Name)] = 'b';
             }
             else
             {
-                variableTypeMap[Node.getLValue()->getValue()] = 'i';
+                variableTypeMap[Flat.getSymbol(Name)] = 'i';
             }
 
-            Expression *rightValue = (Expression *)Node.getRValue();
-            if (rightValue == nullptr)
+            uint32_t Value = Flat.getNextSibling(Name);
+            if (!Flat.hasChild(Node, Value))
             {
                 return;
             }
-            if (Node.getDecType() == DecStatement::DecStatementType::Boolean)
+            FlatAST::NodeKind Kind = Flat.getKind(Value);
+            if (Flat.getOp(Node) == DecStatement::DecStatementType::Boolean)
             {
-                if (!(rightValue->getKind() == Expression::ExpressionType::Boolean ||
-                      rightValue->getKind() == Expression::ExpressionType::BooleanOpType))
+                if (!(Kind == FlatAST::BooleanNode || Kind == FlatAST::BooleanOpNode))
                 {
                     error(WrongValueTypeForVariable, "bool");
                 }
             }
-            else if (Node.getDecType() == DecStatement::DecStatementType::Number)
+            else if (Flat.getOp(Node) == DecStatement::DecStatementType::Number)
             {
-                if (!(rightValue->getKind() == Expression::ExpressionType::Number ||
-                      rightValue->getKind() == Expression::ExpressionType::BinaryOpType))
+                if (!(Kind == FlatAST::NumberNode || Kind == FlatAST::BinaryOpNode))
                 {
                     error(WrongValueTypeForVariable, "int");
                 }
             }
+        }
 
-            rightValue->accept(*this);
-        };
-
-        virtual void visit(IfStatement &Node) override
-        {
-            Expression *declaration = (Expression *)Node.getCondition();
-            declaration->accept(*this);
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-        };
-
-        virtual void visit(ElseIfStatement &Node) override
-        {
-            Expression *declaration = (Expression *)Node.getCondition();
-            declaration->accept(*this);
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-        };
-
-        virtual void visit(ElseStatement &Node) override
-        {
-            llvm::SmallVector<Statement *> stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-        };
-
-        virtual void visit(AssignStatement &Node) override
+        void checkAssignment(const FlatAST &Flat, uint32_t Node)
         {
-            Node.getLValue()->accept(*this);
-            Node.getRValue()->accept(*this);
-            if (variableTypeMap.lookup(Node.getLValue()->getValue()) == 'i' &&
-                (Node.getRValue()->getKind() == Expression::ExpressionType::Boolean ||
-                 Node.getRValue()->getKind() == Expression::ExpressionType::BooleanOpType))
+            uint32_t Name = Node + 1;
+            FlatAST::NodeKind Kind = Flat.getKind(Flat.getNextSibling(Name));
+            if (variableTypeMap[Flat.getSymbol(Name)] == 'i' &&
+                (Kind == FlatAST::BooleanNode || Kind == FlatAST::BooleanOpNode))
             {
                 error(WrongValueTypeForVariable, "int");
             }
-            if (variableTypeMap.lookup(Node.getLValue()->getValue()) == 'b' &&
-                (Node.getRValue()->getKind() == Expression::ExpressionType::Number ||
-                 Node.getRValue()->getKind() == Expression::ExpressionType::BinaryOpType))
+            if (variableTypeMap[Flat.getSymbol(Name)] == 'b' &&
+                (Kind == FlatAST::NumberNode || Kind == FlatAST::BinaryOpNode))
             {
                 error(WrongValueTypeForVariable, "bool");
             }
-        };
-
-        virtual void visit(WhileStatement &Node) override{
-            Node.getCondition()->accept(*this);
-            llvm::SmallVector<Statement* > stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-        };
-        
-        virtual void visit(ForStatement &Node) override{
-            AssignStatement * initial_assign = Node.getInitialAssign();
-            /*if(initial_assign == nullptr){
-                exit(0);
-            }*/
-            (initial_assign->getLValue())->accept(*this);
-            (initial_assign->getRValue())->accept(*this);
-            Node.getCondition()->accept(*this);
-            
-            AssignStatement * update_assign = Node.getUpdateAssign();
-            if(update_assign == nullptr){
-                exit(0);
-            }
-            (update_assign->getLValue())->accept(*this);
-            (update_assign->getRValue())->accept(*this);
-
-            llvm::SmallVector<Statement* > stmts = Node.getStatements();
-            for (auto I = stmts.begin(), E = stmts.end(); I != E; ++I)
-            {
-                (*I)->accept(*this);
-            }
-        };
-
+        }
     };
 }
 
-bool Semantic::semantic(AST *Tree)
+bool Semantic::semantic(AST *Tree, const SymbolTable &Symbols)
 {
     if (!Tree)
         return false;
-    DeclCheck Check;
-    Tree->accept(Check);
+    FlatAST Flat;
+    Flat.build((Base *)Tree);
+    DeclCheck Check(Symbols);
+    Check.check(Flat);
     return Check.hasError();
 }
@@ -7,7 +7,7 @@
 class Semantic
 {
 public:
-    bool semantic(AST *Tree);
+    bool semantic(AST *Tree, const SymbolTable &Symbols);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+// Interns identifier names into dense IDs. The lexer hashes every name once,
+// later stages index plain vectors with the ID instead of hashing strings.
+class SymbolTable
+{
+    llvm::StringMap<unsigned> IDs;
+    llvm::SmallVector<llvm::StringRef, 0> Names;
+
+public:
+    unsigned intern(llvm::StringRef Name)
+    {
+        auto Inserted = IDs.try_emplace(Name, Names.size());
+        if (Inserted.second)
+            Names.push_back(Inserted.first->getKey());
+        return Inserted.first->getValue();
+    }
+
+    llvm::StringRef getName(unsigned ID) const { return Names[ID]; }
+
+    // number of IDs handed out, every ID is below this
+    unsigned size() const { return Names.size(); }
+
+    void clear()
+    {
+        IDs.clear();
+        Names.clear();
+    }
+};
+
+#endif
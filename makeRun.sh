@@ -1,17 +1,13 @@
 #!/bin/bash
 
-# Step 1: Navigate to the build directory and run the compiler
+# Step 1: Navigate to the build directory
 cd build/code/
-./compiler "$(cat ../../input.txt)" > compiler.ll
 
-# Step 2: Compile the support library to an object file, suppressing warnings
-clang -w -c ../../project_lib.c -o lib.o
+# Step 2: Compile the support library to an object file once, suppressing warnings
+[ -f lib.o ] || cc -w -c ../../project_lib.c -o lib.o
 
-# Step 3: Compile the LLVM IR to an object file, suppressing warnings
-clang -w -c compiler.ll -o compiler.o
+# Step 3: Compile the program straight to an executable linked with the support library
+./compiler -f ../../input.txt -filetype=exe -runtime lib.o -o executable
 
-# Step 4: Link the object files to create the executable
-clang compiler.o lib.o -o executable
-
-# Step 5: Execute the program
+# Step 4: Execute the program
 ./executable
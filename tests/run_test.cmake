@@ -0,0 +1,18 @@
+# every optimization level, and the unoptimized AST, must print the same;
+# with TRAPS set the program must also be stopped by a trap
+file(READ ${EXPECTED} Expected)
+foreach(Options "-O=0" "-O=2" "-O=0|-no-ast-opt")
+  string(REPLACE "|" ";" Args "${Options}")
+  execute_process(COMMAND ${COMPILER} ${Args} -run -f ${INPUT}
+    OUTPUT_VARIABLE Output
+    ERROR_QUIET
+    RESULT_VARIABLE Result)
+  if(TRAPS AND Result EQUAL 0)
+    message(FATAL_ERROR "${INPUT} ${Args}: expected a trap")
+  elseif(NOT TRAPS AND NOT Result EQUAL 0)
+    message(FATAL_ERROR "${INPUT} ${Args}: compiler exited with ${Result}")
+  endif()
+  if(NOT Output STREQUAL Expected)
+    message(FATAL_ERROR "${INPUT} ${Args}: expected\n${Expected}got\n${Output}")
+  endif()
+endforeach()